@@ -0,0 +1,190 @@
+#include "approx_batch.h"
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <type_traits>
+
+// Все внутренние циклы идут по линиям (пикселям пакета) с длиной, известной при компиляции,
+// поэтому компилятор векторизует их без явных интринсиков.
+template <typename Scalar, int Lanes>
+static void approximate_batch_orto_lanes(const Scalar* wave,
+    const Scalar* basis,
+    int n_basis,
+    int T,
+    int waves,
+    bool explicit_residual,
+    const int* order,
+    const int* support_begin,
+    const int* support_end,
+    int* e_begin,
+    int* e_end,
+    double* ordered_coefs,
+    double* coefs,
+    double* rmse,
+    Scalar* e,
+    double* factor) {
+    const size_t plane = static_cast<size_t>(T) * Lanes; // один базисный вектор всех пикселей пакета
+    // Коэффициенты ортогонализации: f_k = e_k + sum_{j<k} R(k, j) * e_j (заполняется только j < k)
+    double* R = factor;
+    double* norms = R + static_cast<size_t>(n_basis) * n_basis * Lanes;
+    double acc[Lanes];
+    double scale[Lanes];
+    double energy[Lanes];
+    const double threshold = std::is_same<Scalar, float>::value ? fused_rmse_threshold_f32 : fused_rmse_threshold;
+
+    // Ортогонализация Грама-Шмидта (в той же форме, что gram_schmidt в approx_orto.cpp) в порядке order:
+    // произведения — по пересечению носителей, носитель e_k — оболочка носителей вычитаемых e_j
+    for (int k = 0; k < n_basis; ++k) {
+        Scalar* ek = e + k * plane;
+        const Scalar* fk = basis + order[k] * plane;
+        int lo = support_begin[order[k]];
+        int hi = support_end[order[k]];
+        for (size_t idx = 0; idx < plane; ++idx) ek[idx] = fk[idx];
+
+        for (int j = 0; j < k; ++j) {
+            const Scalar* ej = e + j * plane;
+            const int from = std::max(lo, e_begin[j]);
+            const int to = std::min(hi, e_end[j]);
+            for (int l = 0; l < Lanes; ++l) acc[l] = 0.0;
+            for (int t = from; t < to; ++t)
+                for (int l = 0; l < Lanes; ++l) acc[l] += static_cast<double>(ek[t * Lanes + l]) * ej[t * Lanes + l];
+            bool any = false;
+            for (int l = 0; l < Lanes; ++l) {
+                double norm = norms[j * Lanes + l];
+                scale[l] = (norm != 0) ? acc[l] / norm : 0;
+                R[(static_cast<size_t>(k) * n_basis + j) * Lanes + l] = scale[l];
+                any = any || scale[l] != 0;
+            }
+            if (!any) continue;
+            for (int t = e_begin[j]; t < e_end[j]; ++t)
+                for (int l = 0; l < Lanes; ++l) ek[t * Lanes + l] = static_cast<Scalar>(ek[t * Lanes + l] - scale[l] * ej[t * Lanes + l]);
+            if (e_begin[j] < e_end[j]) {
+                if (lo >= hi) {
+                    lo = e_begin[j];
+                    hi = e_end[j];
+                } else {
+                    lo = std::min(lo, e_begin[j]);
+                    hi = std::max(hi, e_end[j]);
+                }
+            }
+        }
+        if (lo >= hi) lo = hi = 0;
+        e_begin[k] = lo;
+        e_end[k] = hi;
+
+        for (int l = 0; l < Lanes; ++l) acc[l] = 0.0;
+        for (int t = lo; t < hi; ++t)
+            for (int l = 0; l < Lanes; ++l) acc[l] += static_cast<double>(ek[t * Lanes + l]) * ek[t * Lanes + l];
+        for (int l = 0; l < Lanes; ++l) norms[k * Lanes + l] = acc[l];
+    }
+
+    for (int w = 0; w < waves; ++w) {
+        const Scalar* x = wave + w * plane;
+        double* b = ordered_coefs; // в порядке ортогонализации
+
+        // Разложение сигнала по ортогональному базису: a_k = <x, e_k> / <e_k, e_k>,
+        // попутно энергия проекций sum a_k^2 <e_k, e_k>
+        for (int l = 0; l < Lanes; ++l) energy[l] = 0.0;
+        for (int k = 0; k < n_basis; ++k) {
+            const Scalar* ek = e + k * plane;
+            for (int l = 0; l < Lanes; ++l) acc[l] = 0.0;
+            for (int t = e_begin[k]; t < e_end[k]; ++t)
+                for (int l = 0; l < Lanes; ++l) acc[l] += static_cast<double>(x[t * Lanes + l]) * ek[t * Lanes + l];
+            for (int l = 0; l < Lanes; ++l) {
+                double norm = norms[k * Lanes + l];
+                b[k * Lanes + l] = (norm != 0) ? acc[l] / norm : 0;
+                energy[l] += b[k * Lanes + l] * acc[l];
+            }
+        }
+
+        // Обратная подстановка: b_k = a_k - sum_{m>k} R(m, k) * b_m
+        for (int k = n_basis - 1; k >= 0; --k) {
+            for (int m = k + 1; m < n_basis; ++m) {
+                const double* r = R + (static_cast<size_t>(m) * n_basis + k) * Lanes;
+                for (int l = 0; l < Lanes; ++l) b[k * Lanes + l] -= r[l] * b[m * Lanes + l];
+            }
+        }
+
+        // RMSE по энергии проекций; явный остаток — только если хотя бы в одной линии сокращение
+        for (int l = 0; l < Lanes; ++l) acc[l] = 0.0;
+        for (int t = 0; t < T; ++t)
+            for (int l = 0; l < Lanes; ++l) acc[l] += static_cast<double>(x[t * Lanes + l]) * x[t * Lanes + l];
+        bool reliable = !explicit_residual;
+        for (int l = 0; l < Lanes; ++l) {
+            double residual2;
+            reliable = fused_residual(acc[l], energy[l], threshold, residual2) && reliable;
+            rmse[w * Lanes + l] = std::sqrt(std::max(0.0, residual2) / T);
+        }
+        if (!reliable) {
+            // RMSE по явному остатку x - f_k^T * b
+            for (int l = 0; l < Lanes; ++l) acc[l] = 0.0;
+            for (int t = 0; t < T; ++t) {
+                double residual[Lanes];
+                for (int l = 0; l < Lanes; ++l) residual[l] = x[t * Lanes + l];
+                for (int k = 0; k < n_basis; ++k) {
+                    const Scalar* fk = basis + order[k] * plane + t * Lanes;
+                    for (int l = 0; l < Lanes; ++l) residual[l] -= b[k * Lanes + l] * fk[l];
+                }
+                for (int l = 0; l < Lanes; ++l) acc[l] += residual[l] * residual[l];
+            }
+            for (int l = 0; l < Lanes; ++l) rmse[w * Lanes + l] = std::sqrt(acc[l] / T);
+        }
+
+        // Коэффициенты в исходном порядке базисных функций
+        double* out = coefs + static_cast<size_t>(w) * n_basis * Lanes;
+        for (int k = 0; k < n_basis; ++k)
+            for (int l = 0; l < Lanes; ++l) out[order[k] * Lanes + l] = b[k * Lanes + l];
+    }
+}
+
+bool is_supported_batch_lanes(int lanes) {
+    return lanes == 4 || lanes == 8 || lanes == 16;
+}
+
+template <typename Scalar>
+bool BatchBuffers<Scalar>::reserve(int n_basis, int T, int lanes_, int waves_) {
+    size_t n = static_cast<size_t>(n_basis);
+    if (lanes == lanes_ && waves == waves_ && basis.size() == n * T * lanes_ && coefs.size() == n * lanes_ * waves_) return false;
+    lanes = lanes_;
+    waves = waves_;
+    wave.resize(static_cast<size_t>(waves) * T * lanes);
+    basis.resize(n * T * lanes);
+    e.resize(n * T * lanes);
+    factor.resize(n * (n + 1) * lanes);
+    support_begin.assign(n, 0);
+    support_end.assign(n, T);
+    e_support.resize(3 * n);
+    ordered_coefs.resize(n * lanes);
+    coefs.resize(static_cast<size_t>(waves) * n * lanes);
+    rmse.resize(static_cast<size_t>(waves) * lanes);
+    return true;
+}
+
+template <typename Scalar>
+void approximate_batch_orto(int n_basis, int T, BatchBuffers<Scalar>& buffers) {
+    // Порядок ортогонализации — по убыванию начала носителя (при reorder_by_support), как в approx_orto.cpp
+    int* order = buffers.e_support.data() + 2 * n_basis;
+    std::iota(order, order + n_basis, 0);
+    if (buffers.reorder_by_support)
+        std::stable_sort(order, order + n_basis, [&buffers](int a, int b) { return buffers.support_begin[a] > buffers.support_begin[b]; });
+    switch (buffers.lanes) {
+    case 4:  approximate_batch_orto_lanes<Scalar, 4>(buffers.wave.data(), buffers.basis.data(), n_basis, T, buffers.waves,
+                 buffers.explicit_residual, order,
+                 buffers.support_begin.data(), buffers.support_end.data(), buffers.e_support.data(), buffers.e_support.data() + n_basis,
+                 buffers.ordered_coefs.data(), buffers.coefs.data(), buffers.rmse.data(), buffers.e.data(), buffers.factor.data()); break;
+    case 8:  approximate_batch_orto_lanes<Scalar, 8>(buffers.wave.data(), buffers.basis.data(), n_basis, T, buffers.waves,
+                 buffers.explicit_residual, order,
+                 buffers.support_begin.data(), buffers.support_end.data(), buffers.e_support.data(), buffers.e_support.data() + n_basis,
+                 buffers.ordered_coefs.data(), buffers.coefs.data(), buffers.rmse.data(), buffers.e.data(), buffers.factor.data()); break;
+    case 16: approximate_batch_orto_lanes<Scalar, 16>(buffers.wave.data(), buffers.basis.data(), n_basis, T, buffers.waves,
+                 buffers.explicit_residual, order,
+                 buffers.support_begin.data(), buffers.support_end.data(), buffers.e_support.data(), buffers.e_support.data() + n_basis,
+                 buffers.ordered_coefs.data(), buffers.coefs.data(), buffers.rmse.data(), buffers.e.data(), buffers.factor.data()); break;
+    default: break;
+    }
+}
+
+template struct BatchBuffers<double>;
+template struct BatchBuffers<float>;
+template void approximate_batch_orto<double>(int, int, BatchBuffers<double>&);
+template void approximate_batch_orto<float>(int, int, BatchBuffers<float>&);
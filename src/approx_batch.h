@@ -0,0 +1,61 @@
+#ifndef APPROX_BATCH_H
+#define APPROX_BATCH_H
+
+#include <cstddef>
+#include <vector>
+
+// Пакетная аппроксимация сразу для нескольких соседних пикселей (по одному пикселю на SIMD-линию).
+// Данные хранятся с пикселем во внутреннем измерении (structure of arrays):
+//   wave  [waves][T][lanes]          — сигналы (сценарии) каждого пикселя пакета
+//   basis [n_basis][T][lanes]        — базис каждого пикселя пакета
+// Результат:
+//   coefs [waves][n_basis][lanes]    — коэффициенты, как у approximate_with_non_orthogonal_basis_orto
+//   rmse  [waves][lanes]             — среднеквадратичная ошибка аппроксимации (по энергии проекций,
+//                                      при сокращении — по явному остатку)
+// Базис каждого пикселя ортогонализуется один раз для всех сигналов.
+// Scalar — тип хранения (double или float); скалярные произведения, множитель R и нормы
+// всегда считаются в double.
+
+// RMSE по энергии проекций: |x - approx|^2 = |x|^2 - |approx|^2, так как остаток ортогонален базису.
+// Разности можно доверять, пока остаток не меньше доли threshold от |x|^2; при более сильном
+// сокращении ядра считают RMSE по явному остатку
+constexpr double fused_rmse_threshold = 1e-4;     // ортогональный базис в double
+constexpr double fused_rmse_threshold_f32 = 1e-2; // ортогональный базис хранится во float
+
+// Квадрат остатка по энергии проекций; false — результат ненадёжен из-за сокращения
+inline bool fused_residual(double x_norm2, double energy, double threshold, double& residual2) {
+    residual2 = x_norm2 - energy;
+    return residual2 >= threshold * x_norm2;
+}
+
+// Поддерживаемые размеры пакета: 4, 8 и 16 пикселей
+bool is_supported_batch_lanes(int lanes);
+
+// Буферы пакетного решателя для одного потока
+template <typename Scalar>
+struct BatchBuffers {
+    int lanes = 0;
+    int waves = 1;
+    std::vector<Scalar> wave;   // [waves][T][lanes]
+    std::vector<Scalar> basis;  // [n_basis][T][lanes]
+    std::vector<Scalar> e;      // [n_basis][T][lanes] — ортогональный базис
+    std::vector<double> factor; // множитель R [n_basis][n_basis][lanes] и нормы [n_basis][lanes]
+    std::vector<double> coefs;  // [waves][n_basis][lanes]
+    std::vector<double> rmse;   // [waves][lanes]
+    bool explicit_residual = false; // RMSE всегда по явному остатку (для отладки)
+    // Носители базисных функций [support_begin[b], support_end[b]), общие для всех пикселей
+    // пакета (объединение носителей); вне их basis должен быть нулевым. reserve() ставит [0, T)
+    std::vector<int> support_begin;
+    std::vector<int> support_end;
+    bool reorder_by_support = false; // как OrtoWorkspace::reorder_by_support
+    std::vector<int> e_support; // носители строк e и порядок ортогонализации: [3][n_basis]
+    std::vector<double> ordered_coefs; // [n_basis][lanes] — коэффициенты в порядке ортогонализации
+
+    // Подготовить буферы под размеры; возвращает true, если пришлось выделять память
+    bool reserve(int n_basis, int T, int lanes, int waves = 1);
+};
+
+template <typename Scalar>
+void approximate_batch_orto(int n_basis, int T, BatchBuffers<Scalar>& buffers);
+
+#endif // APPROX_BATCH_H
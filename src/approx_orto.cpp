@@ -2,99 +2,274 @@
 #include <iostream>
 #include <cmath>
 #include <iomanip>
+#include <atomic>
+#include <algorithm>
+#include <limits>
+#include <numeric>
 
-// Функция для скалярного произведения двух векторов с использованием Eigen
-inline double dot_product(const Vector& v1, const Vector& v2) {
-    return v1.dot(v2);
-}
-
-// Функция для ортогонализации системы векторов методом Грама-Шмидта с использованием Eigen
-Matrix gram_schmidt(const Matrix& vectors) {
-    size_t n = vectors.rows();
-    Matrix orthogonal_vectors = Matrix::Zero(vectors.rows(), vectors.cols());
-    for (size_t i = 0; i < n; ++i) {
-        Vector new_vector = vectors.row(i);
-        if (i == 0) {
-            orthogonal_vectors.row(0) = new_vector;
-        } else {
-            for (size_t j = 0; j < i; ++j) {
-                double scale = dot_product(new_vector, orthogonal_vectors.row(j)) /
-                               dot_product(orthogonal_vectors.row(j), orthogonal_vectors.row(j));
-                new_vector -= scale * orthogonal_vectors.row(j);
+// Типы рабочих матриц n x n ядра. N — число базисных функций, известное при компиляции,
+// либо Eigen::Dynamic для общего случая (тогда это обычные MatrixXd/VectorXd).
+template <int N>
+using SquareMatrix = Eigen::Matrix<double, N, N>;
+template <int N>
+using CoefVector = Eigen::Matrix<double, N, 1>;
+
+// Счётчик выделений рабочей памяти во всех потоках
+static std::atomic<size_t> workspace_allocations{ 0 };
+
+size_t workspace_allocation_count() {
+    return workspace_allocations.load();
+}
+
+void OrtoWorkspace::reserve(int n_basis, int T) {
+    if (basis.rows() == n_basis && basis.cols() == T) return;
+    basis.resize(n_basis, T);
+    wave.resize(T);
+    approximation.resize(T);
+    coefs.resize(n_basis);
+    e.resize(n_basis, T);
+    R.resize(n_basis, n_basis);
+    norms.resize(n_basis);
+    a.resize(n_basis);
+    support_begin.setZero(n_basis);
+    support_end.setConstant(n_basis, T);
+    e_begin.resize(n_basis);
+    order.resize(n_basis);
+    ordered_coefs.resize(n_basis);
+    e_end.resize(n_basis);
+    G.resize(n_basis, n_basis);
+    rhs.resize(n_basis);
+    llt = Eigen::LLT<Matrix, Eigen::Lower>(n_basis);
+    ldlt = Eigen::LDLT<Matrix, Eigen::Lower>(n_basis);
+    ++workspace_allocations;
+}
+
+void OrtoWorkspace::reserve_waves(int n_basis, int T, int k) {
+    reserve(n_basis, T);
+    if (waves.rows() == T && waves.cols() == k && coefs_multi.rows() == n_basis) return;
+    waves.resize(T, k);
+    projections.resize(n_basis, k);
+    coefs_multi.resize(n_basis, k);
+    approximation_multi.resize(T, k);
+    rmse_multi.resize(k);
+    ++workspace_allocations;
+}
+
+template <typename Scalar>
+void OrtoWorkspace::reserve_batch(int n_basis, int T, int lanes, int waves_count) {
+    if (batch_buffers<Scalar>().reserve(n_basis, T, lanes, waves_count)) {
+        ++workspace_allocations;
+    }
+}
+
+template void OrtoWorkspace::reserve_batch<double>(int, int, int, int);
+template void OrtoWorkspace::reserve_batch<float>(int, int, int, int);
+
+// Расширение носителя [lo, hi) до выпуклой оболочки с [begin, end); пустой носитель — lo >= hi
+static void extend_support(Eigen::Index& lo, Eigen::Index& hi, Eigen::Index begin, Eigen::Index end) {
+    if (begin >= end) return;
+    if (lo >= hi) {
+        lo = begin;
+        hi = end;
+        return;
+    }
+    lo = std::min(lo, begin);
+    hi = std::max(hi, end);
+}
+
+// Функция для ортогонализации системы векторов методом Грама-Шмидта с использованием Eigen.
+// Помимо ортогонального базиса e возвращает треугольный множитель R (f_i = e_i + sum_{j<i} R(i, j) * e_j)
+// и квадраты норм <e_i, e_i>. Векторы обрабатываются в порядке order (e_i строится из vectors(order[i]),
+// R и norms — в том же порядке). Строка vectors(b) должна быть нулевой вне [begin[b], end[b]);
+// носители строк e — в e_begin/e_end, произведения считаются только по пересечению носителей
+template <int N, typename EMatrix, typename RMatrix, typename NormVector>
+void gram_schmidt(const Matrix& vectors, EMatrix& orthogonal_vectors, RMatrix& R, NormVector& norms,
+    const Eigen::VectorXi& order, const Eigen::VectorXi& begin, const Eigen::VectorXi& end,
+    Eigen::VectorXi& e_begin, Eigen::VectorXi& e_end) {
+    const Eigen::Index n = (N == Eigen::Dynamic) ? vectors.rows() : N;
+    R.setZero(n, n);
+    for (Eigen::Index i = 0; i < n; ++i) {
+        Eigen::Index lo = begin[order[i]];
+        Eigen::Index hi = end[order[i]];
+        orthogonal_vectors.row(i) = vectors.row(order[i]);
+        for (Eigen::Index j = 0; j < i; ++j) {
+            Eigen::Index from = std::max(lo, Eigen::Index(e_begin[j]));
+            Eigen::Index to = std::min(hi, Eigen::Index(e_end[j]));
+            double dot = (from < to) ? orthogonal_vectors.row(i).segment(from, to - from).dot(orthogonal_vectors.row(j).segment(from, to - from)) : 0;
+            double scale = (norms[j] != 0) ? dot / norms[j] : 0;
+            if (scale != 0) {
+                Eigen::Index length = e_end[j] - e_begin[j];
+                orthogonal_vectors.row(i).segment(e_begin[j], length) -= scale * orthogonal_vectors.row(j).segment(e_begin[j], length);
+                extend_support(lo, hi, e_begin[j], e_end[j]);
             }
-            orthogonal_vectors.row(i) = new_vector;
+            R(i, j) = scale;
+        }
+        if (lo >= hi) {
+            lo = hi = 0;
         }
+        e_begin[i] = static_cast<int>(lo);
+        e_end[i] = static_cast<int>(hi);
+        norms[i] = orthogonal_vectors.row(i).segment(lo, hi - lo).squaredNorm();
     }
-    return orthogonal_vectors;
 }
 
 // Функция для разложения вектора по ортогональному базису с использованием Eigen
-Vector decompose_vector(const Vector& v, const Matrix& orthogonal_basis) {
-    Vector coefficients(orthogonal_basis.rows());
-    for (size_t i = 0; i < orthogonal_basis.rows(); ++i) {
-        double denominator = dot_product(orthogonal_basis.row(i), orthogonal_basis.row(i));
-        coefficients[i] = (denominator != 0) ? dot_product(v, orthogonal_basis.row(i)) / denominator : 0;
-    }
-    return coefficients;
-}
-
-// Вычисление l_k_i для конкретных индексов k и i
-inline double compute_l_k_i(const Vector& f_k_i, const Vector& e_i) {
-    double dot_fk_ei = dot_product(f_k_i, e_i);
-    double dot_ei_ei = dot_product(e_i, e_i);
-    return (dot_ei_ei == 0) ? 0 : -dot_fk_ei / dot_ei_ei;
-}
-
-// Итеративная версия вычисления матрицы F
-Matrix compute_F_matrix(const Matrix& l) {
-    size_t n = l.rows();
-    Matrix F_matrix = Matrix::Zero(n, n);
-    for (size_t i = 0; i < n; ++i) {
-        for (size_t j = i + 1; j < n; ++j) {
-            double sum_part = 0;
-            for (size_t k = i + 1; k < j; ++k) {
-                sum_part += l(j, k) * F_matrix(k, i);
-            }
-            F_matrix(j, i) = l(j, i) + sum_part;
-        }
+// (по носителям строк e из gram_schmidt)
+template <typename EMatrix, typename NormVector, typename CoefVectorOut>
+void decompose_vector(const Vector& v, const EMatrix& orthogonal_basis, const NormVector& norms,
+    const Eigen::VectorXi& e_begin, const Eigen::VectorXi& e_end, CoefVectorOut& coefficients) {
+    for (Eigen::Index i = 0; i < norms.size(); ++i) {
+        Eigen::Index length = e_end[i] - e_begin[i];
+        coefficients[i] = (norms[i] != 0) ? orthogonal_basis.row(i).segment(e_begin[i], length).dot(v.segment(e_begin[i], length).transpose()) / norms[i] : 0;
     }
-    return F_matrix;
 }
 
-// Вычисление вектора b
-Vector compute_bi(size_t k, const Vector& a_k, const Matrix& l) {
-    Vector b = Vector::Zero(a_k.size());
-    Matrix F_matrix = compute_F_matrix(l);
-    b[k] = a_k[k];
-    b[k - 1] = a_k[k - 1] + a_k[k] * F_matrix(k, k - 1);
-    b[k - 2] = a_k[k - 2] + a_k[k - 1] * F_matrix(k - 1, k - 2) + a_k[k] * F_matrix(k, k - 2);
-    for (int i = static_cast<int>(k) - 3; i >= 0; --i) {
+// Переход от коэффициентов по ортогональному базису к коэффициентам по исходному:
+// a_i = b_i + sum_{k>i} R(k, i) * b_k, т.е. обратная подстановка с единичной треугольной матрицей за O(n^2)
+template <typename RMatrix, typename CoefVectorIn, typename CoefVectorOut>
+void back_substitution(const RMatrix& R, const CoefVectorIn& a_k, CoefVectorOut& b) {
+    const Eigen::Index n = a_k.size();
+    for (Eigen::Index i = n - 1; i >= 0; --i) {
         double sum_part = 0;
-        for (size_t j = i + 1; j <= k; ++j) {
-            sum_part += a_k[j] * F_matrix(j, i);
+        for (Eigen::Index k = i + 1; k < n; ++k) {
+            sum_part += R(k, i) * b[k];
         }
-        b[i] = a_k[i] + sum_part;
+        b[i] = a_k[i] - sum_part;
+    }
+}
+
+// RMSE по энергии аппроксимации energy = |f_k^T * coefs|^2; если разность ненадёжна
+// (сильное сокращение), остаток x - f_k^T * coefs считается явно
+template <typename CoefVectorIn>
+static double fused_rmse(const Vector& x, const Matrix& f_k, const CoefVectorIn& coefs, double energy, double threshold, Vector& approximation) {
+    double residual2;
+    if (!fused_residual(x.squaredNorm(), energy, threshold, residual2)) {
+        approximation.noalias() = f_k.transpose() * coefs;
+        residual2 = (x - approximation).squaredNorm();
+    }
+    return std::sqrt(std::max(0.0, residual2) / x.size());
+}
+
+// Энергия разложения по ортогональному базису: sum a_i^2 <e_i, e_i>
+template <typename NormVector, typename CoefVectorIn>
+static double projection_energy(const NormVector& norms, const CoefVectorIn& a) {
+    return a.cwiseAbs2().dot(norms);
+}
+
+// Порядок ортогонализации: по убыванию начала носителя (сначала функции с поздним приходом волны).
+// Тогда носители e_i растут постепенно и произведения в gram_schmidt короче;
+// при одинаковых носителях и без reorder порядок остаётся исходным
+static void support_order(const Eigen::VectorXi& begin, bool reorder, Eigen::VectorXi& order) {
+    std::iota(order.data(), order.data() + order.size(), 0);
+    if (!reorder) return;
+    std::stable_sort(order.data(), order.data() + order.size(), [&begin](int a, int b) { return begin[a] > begin[b]; });
+}
+
+// Основная функция аппроксимации (ортогонализованный метод) для N базисных функций.
+// Матрицы n x n при фиксированном N лежат на стеке, в общем случае — в рабочей памяти
+template <int N>
+void approximate_orto(const Vector& x, const Matrix& f_k, OrtoWorkspace& ws) {
+    ws.reserve(static_cast<int>(f_k.rows()), static_cast<int>(f_k.cols()));
+    support_order(ws.support_begin, ws.reorder_by_support, ws.order);
+    if constexpr (N == Eigen::Dynamic) {
+        // Ортогонализация базиса
+        gram_schmidt<N>(f_k, ws.e, ws.R, ws.norms, ws.order, ws.support_begin, ws.support_end, ws.e_begin, ws.e_end);
+        // Разложение вектора x по ортогональному базису
+        decompose_vector(x, ws.e, ws.norms, ws.e_begin, ws.e_end, ws.a);
+        // Вычисляем результирующий вектор коэффициентов (в порядке ортогонализации)
+        back_substitution(ws.R, ws.a, ws.ordered_coefs);
+        for (Eigen::Index k = 0; k < ws.order.size(); ++k) ws.coefs[ws.order[k]] = ws.ordered_coefs[k];
+        ws.rmse = fused_rmse(x, f_k, ws.coefs, projection_energy(ws.norms, ws.a), fused_rmse_threshold, ws.approximation);
+    } else {
+        SquareMatrix<N> R;
+        CoefVector<N> norms;
+        CoefVector<N> a_k;
+        CoefVector<N> b_k;
+        gram_schmidt<N>(f_k, ws.e, R, norms, ws.order, ws.support_begin, ws.support_end, ws.e_begin, ws.e_end);
+        decompose_vector(x, ws.e, norms, ws.e_begin, ws.e_end, a_k);
+        back_substitution(R, a_k, b_k);
+        for (int k = 0; k < N; ++k) ws.coefs[ws.order[k]] = b_k[k];
+        ws.rmse = fused_rmse(x, f_k, ws.coefs, projection_energy(norms, a_k), fused_rmse_threshold, ws.approximation);
     }
-    return b;
 }
 
-// Основная функция аппроксимации (ортогонализованный метод)
+// Версия для фиксированного N; при несовпадении числа базисных функций — общий случай
+template <int N>
+void approximate_orto_fixed(const Vector& x, const Matrix& f_k, OrtoWorkspace& ws) {
+    if (f_k.rows() != N) {
+        approximate_orto<Eigen::Dynamic>(x, f_k, ws);
+        return;
+    }
+    approximate_orto<N>(x, f_k, ws);
+}
+
+void approximate_with_non_orthogonal_basis_orto(const Vector& x, const Matrix& f_k, OrtoWorkspace& ws) {
+    approximate_orto<Eigen::Dynamic>(x, f_k, ws);
+}
+
 Vector approximate_with_non_orthogonal_basis_orto(const Vector& x, const Matrix& f_k) {
-    // Ортогонализация базиса
-    Matrix e_i = gram_schmidt(f_k);
-    // Разложение вектора x по ортогональному базису
-    Vector a_k = decompose_vector(x, e_i);
-    // Вычисление матрицы l_k_i
-    Matrix l_k_i(f_k.rows(), f_k.cols());
-    for (size_t k = 0; k < f_k.rows(); ++k) {
-        for (size_t i = 0; i < e_i.rows(); ++i) {
-            l_k_i(k, i) = compute_l_k_i(f_k.row(k), e_i.row(i));
+    OrtoWorkspace ws;
+    approximate_orto<Eigen::Dynamic>(x, f_k, ws);
+    return ws.coefs;
+}
+
+void orto_factor(const Matrix& f_k, OrtoWorkspace& ws) {
+    ws.reserve(static_cast<int>(f_k.rows()), static_cast<int>(f_k.cols()));
+    // Исходный порядок: R и e используются orto_solve_multi и кэшем разложений без перестановки
+    std::iota(ws.order.data(), ws.order.data() + ws.order.size(), 0);
+    gram_schmidt<Eigen::Dynamic>(f_k, ws.e, ws.R, ws.norms, ws.order, ws.support_begin, ws.support_end, ws.e_begin, ws.e_end);
+}
+
+void orto_solve_multi(const Matrix& waves,
+    const Eigen::Ref<const RowMatrix>& e,
+    const Eigen::Ref<const Matrix>& R,
+    const Eigen::Ref<const Vector>& norms,
+    OrtoWorkspace& ws) {
+    ws.reserve_waves(static_cast<int>(norms.size()), static_cast<int>(waves.rows()), static_cast<int>(waves.cols()));
+    // Коэффициенты по ортогональному базису для всех сигналов сразу: a = D^-1 * e * waves
+    ws.projections.noalias() = e * waves;
+    for (Eigen::Index i = 0; i < norms.size(); ++i) {
+        ws.projections.row(i) *= (norms[i] != 0) ? 1.0 / norms[i] : 0.0;
+    }
+    // Обратная подстановка (I + R^T) * b = a для всех столбцов
+    ws.coefs_multi = ws.projections;
+    R.transpose().triangularView<Eigen::UnitUpper>().solveInPlace(ws.coefs_multi);
+
+    // RMSE по энергии проекций; при сокращении — явный остаток x - e^T * a
+    // (равен x - f_k^T * b, но не требует исходного базиса)
+    for (Eigen::Index w = 0; w < waves.cols(); ++w) {
+        double residual2;
+        if (!fused_residual(waves.col(w).squaredNorm(), projection_energy(norms, ws.projections.col(w)), fused_rmse_threshold, residual2)) {
+            ws.approximation_multi.col(w).noalias() = e.transpose() * ws.projections.col(w);
+            residual2 = (waves.col(w) - ws.approximation_multi.col(w)).squaredNorm();
         }
+        ws.rmse_multi[w] = std::sqrt(std::max(0.0, residual2) / waves.rows());
+    }
+}
+
+void orto_solve_multi(const Matrix& waves, OrtoWorkspace& ws) {
+    orto_solve_multi(waves, ws.e, ws.R, ws.norms, ws);
+}
+
+OrtoKernel select_orto_kernel(int n_basis) {
+    switch (n_basis) {
+    case 6:  return approximate_orto_fixed<6>;
+    case 8:  return approximate_orto_fixed<8>;
+    case 9:  return approximate_orto_fixed<9>;
+    case 10: return approximate_orto_fixed<10>;
+    case 12: return approximate_orto_fixed<12>;
+    case 15: return approximate_orto_fixed<15>;
+    case 16: return approximate_orto_fixed<16>;
+    case 18: return approximate_orto_fixed<18>;
+    case 20: return approximate_orto_fixed<20>;
+    case 24: return approximate_orto_fixed<24>;
+    case 25: return approximate_orto_fixed<25>;
+    case 30: return approximate_orto_fixed<30>;
+    case 36: return approximate_orto_fixed<36>;
+    case 40: return approximate_orto_fixed<40>;
+    case 48: return approximate_orto_fixed<48>;
+    default: return approximate_with_non_orthogonal_basis_orto;
     }
-    // Вычисляем результирующий вектор коэффициентов
-    size_t k = a_k.size() - 1;
-    Vector b = compute_bi(k, a_k, l_k_i);
-    return b;
 }
 
 // Обёртка для работы со стандартными векторами
@@ -114,3 +289,87 @@ std::vector<double> approximate_with_non_orthogonal_basis_orto_std(
     Vector result = approximate_with_non_orthogonal_basis_orto(x, f_k);
     return std::vector<double>(result.data(), result.data() + result.size());
 }
+
+
+// Порог обусловленности матрицы Грама (по отношению квадратов диагонали множителя Холецкого),
+// ниже которого вместо Холецкого используется LDL^T
+constexpr double gram_rcond_threshold = 1e-12;
+
+// Разложение Холецкого матрицы ws.G; при плохой обусловленности — LDL^T с выбором ведущего элемента.
+// Возвращает true, если использован Холецкий (ws.llt), иначе — ws.ldlt.
+// rcond — оценка обратной обусловленности G (0 при переходе на LDL^T)
+static bool factor_gram(OrtoWorkspace& ws, double& rcond) {
+    ws.llt.compute(ws.G);
+    if (ws.llt.info() == Eigen::Success) {
+        auto diagonal = ws.llt.matrixLLT().diagonal();
+        double ratio = diagonal.minCoeff() / diagonal.maxCoeff();
+        rcond = ratio * ratio;
+        if (rcond > gram_rcond_threshold) {
+            return true;
+        }
+    }
+    rcond = 0;
+    ws.ldlt.compute(ws.G);
+    return false;
+}
+
+// Порог сокращения для RMSE по энергии c^T * rhs: ошибка энергии растёт с обусловленностью G,
+// поэтому порог не меньше eps / rcond с запасом; при LDL^T остаток всегда считается явно
+static double gram_rmse_threshold(double rcond) {
+    if (rcond == 0) return std::numeric_limits<double>::infinity();
+    return std::max(fused_rmse_threshold, 1e4 * std::numeric_limits<double>::epsilon() / rcond);
+}
+
+// Аппроксимация через матрицу Грама (нормальные уравнения)
+void approximate_with_non_orthogonal_basis_gram(const Vector& x, const Matrix& f_k, OrtoWorkspace& ws) {
+    const Eigen::Index n = f_k.rows();
+    ws.reserve(static_cast<int>(n), static_cast<int>(f_k.cols()));
+    // Матрица Грама (нижний треугольник) и правая часть f_k * x за один проход по T: столбец j
+    // и rhs[j] — только по носителю f_j (ws.support_begin/end)
+    ws.G.setZero();
+    for (Eigen::Index j = 0; j < n; ++j) {
+        auto G_j = ws.G.col(j).tail(n - j);
+        double rhs_j = 0;
+        for (Eigen::Index t = ws.support_begin[j]; t < ws.support_end[j]; ++t) {
+            const double f_jt = f_k(j, t);
+            G_j.noalias() += f_jt * f_k.col(t).tail(n - j);
+            rhs_j += f_jt * x[t];
+        }
+        ws.rhs[j] = rhs_j;
+    }
+    double rcond;
+    if (factor_gram(ws, rcond)) {
+        ws.coefs = ws.llt.solve(ws.rhs);
+    } else {
+        ws.coefs = ws.ldlt.solve(ws.rhs);
+    }
+    // |f_k^T * c|^2 = c^T * G * c = c^T * rhs
+    ws.rmse = fused_rmse(x, f_k, ws.coefs, ws.coefs.dot(ws.rhs), gram_rmse_threshold(rcond), ws.approximation);
+}
+
+void approximate_with_non_orthogonal_basis_gram_multi(const Matrix& waves, const Matrix& f_k, OrtoWorkspace& ws) {
+    ws.reserve_waves(static_cast<int>(f_k.rows()), static_cast<int>(f_k.cols()), static_cast<int>(waves.cols()));
+    ws.G.setZero();
+    ws.G.selfadjointView<Eigen::Lower>().rankUpdate(f_k);
+    ws.projections.noalias() = f_k * waves;
+    double rcond;
+    if (factor_gram(ws, rcond)) {
+        ws.coefs_multi = ws.llt.solve(ws.projections);
+    } else {
+        ws.coefs_multi = ws.ldlt.solve(ws.projections);
+    }
+    for (Eigen::Index w = 0; w < waves.cols(); ++w) {
+        double residual2;
+        if (!fused_residual(waves.col(w).squaredNorm(), ws.coefs_multi.col(w).dot(ws.projections.col(w)), gram_rmse_threshold(rcond), residual2)) {
+            ws.approximation_multi.col(w).noalias() = f_k.transpose() * ws.coefs_multi.col(w);
+            residual2 = (waves.col(w) - ws.approximation_multi.col(w)).squaredNorm();
+        }
+        ws.rmse_multi[w] = std::sqrt(std::max(0.0, residual2) / waves.rows());
+    }
+}
+
+Vector approximate_with_non_orthogonal_basis_gram(const Vector& x, const Matrix& f_k) {
+    OrtoWorkspace ws;
+    approximate_with_non_orthogonal_basis_gram(x, f_k, ws);
+    return ws.coefs;
+}
@@ -3,16 +3,119 @@
 
 #include <vector>
 #include <Eigen/Dense>
+#include "approx_batch.h"
 
 using Vector = Eigen::VectorXd;
 using Matrix = Eigen::MatrixXd;
+using RowMatrix = Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
+// Рабочая память ядер аппроксимации. Создаётся один раз на поток, размеры задаются reserve()
+// под (n_basis, T) и дальше переиспользуются для всех пикселей без выделений памяти.
+struct OrtoWorkspace {
+    Matrix basis;         // n_basis x T — базис текущего пикселя
+    Vector wave;          // T — сигнал текущего пикселя
+    Vector approximation; // T — аппроксимированный сигнал
+    Vector coefs;         // n_basis — результат: коэффициенты по исходному базису
+    double rmse = 0;      // результат: среднеквадратичная ошибка аппроксимации
+
+    // Носители базисных функций [support_begin[b], support_end[b]) (basis_support.h): вне их
+    // значения f_k должны быть нулевыми, скалярные произведения там не вычисляются.
+    // reserve() при выделении ставит полный ряд [0, T); вызывающий код задаёт носители для каждого пикселя
+    Eigen::VectorXi support_begin;
+    Eigen::VectorXi support_end;
+    // Ортогонализация по убыванию начала носителя (support_order в approx_orto.cpp). Без порога носителя
+    // (support_threshold = 0) выключена: базис ортогонализуется в исходном порядке, как без носителей
+    bool reorder_by_support = false;
+
+    // Ортогонализация
+    RowMatrix e;          // n_basis x T — ортогональный базис (по строкам)
+    Matrix R;             // n_basis x n_basis — треугольный множитель ортогонализации
+    Vector norms;         // n_basis — квадраты норм <e_i, e_i>
+    Vector a;             // n_basis — коэффициенты по ортогональному базису
+    Eigen::VectorXi order;   // n_basis — порядок ортогонализации (строка e_k построена из f_k[order[k]])
+    Eigen::VectorXi e_begin; // n_basis — носители строк e
+    Eigen::VectorXi e_end;
+    Vector ordered_coefs;    // n_basis — коэффициенты в порядке ортогонализации
+
+    // Несколько сигналов (сценариев wave) для одного базиса
+    Matrix waves;               // T x k — сигналы по столбцам
+    Matrix projections;         // n_basis x k — коэффициенты по ортогональному базису (или f_k * waves)
+    Matrix coefs_multi;         // n_basis x k — результат
+    Matrix approximation_multi; // T x k
+    Vector rmse_multi;          // k — среднеквадратичная ошибка для каждого сигнала
+
+    // Решатель через матрицу Грама
+    Matrix G;
+    Vector rhs;
+    Eigen::LLT<Matrix, Eigen::Lower> llt;
+    Eigen::LDLT<Matrix, Eigen::Lower> ldlt;
+
+    // Пакетный решатель (approx_batch.h) для данных в double и во float
+    BatchBuffers<double> batch;
+    BatchBuffers<float> batch_f32;
+
+    // Подготовить память под n_basis базисных функций длины T (выделяет только при изменении размеров)
+    void reserve(int n_basis, int T);
+    // То же для k сигналов на пиксель
+    void reserve_waves(int n_basis, int T, int k);
+    // То же для буферов пакетного решателя на lanes пикселей с типом хранения Scalar
+    template <typename Scalar>
+    void reserve_batch(int n_basis, int T, int lanes, int waves = 1);
+    template <typename Scalar>
+    BatchBuffers<Scalar>& batch_buffers();
+};
+
+template <>
+inline BatchBuffers<double>& OrtoWorkspace::batch_buffers<double>() { return batch; }
+template <>
+inline BatchBuffers<float>& OrtoWorkspace::batch_buffers<float>() { return batch_f32; }
+
+// Сколько раз рабочая память OrtoWorkspace выделялась заново (в установившемся режиме не растёт)
+size_t workspace_allocation_count();
 
 // Функция аппроксимации с использованием ортогонализации (реализация в approx_orto.cpp)
 Vector approximate_with_non_orthogonal_basis_orto(const Vector& x, const Matrix& f_k);
 
+// Вариант без выделения памяти: промежуточные данные — в ws, результат — в ws.coefs и ws.rmse.
+// RMSE считается по энергии проекций (fused_residual), без вычисления f_k^T * coefs;
+// явный остаток — только при сильном сокращении. x и f_k могут быть ws.wave и ws.basis
+void approximate_with_non_orthogonal_basis_orto(const Vector& x, const Matrix& f_k, OrtoWorkspace& ws);
+
+// Разложение базиса одного пикселя для решения с несколькими сигналами:
+// ортогонализация f_k, результат в ws.e, ws.R, ws.norms
+void orto_factor(const Matrix& f_k, OrtoWorkspace& ws);
+
+// Коэффициенты для всех сигналов waves (T x k) по разложению из orto_factor: одно произведение
+// e * waves и треугольное решение, результат в ws.coefs_multi (n_basis x k) и ws.rmse_multi,
+// коэффициенты по ортогональному базису — в ws.projections
+void orto_solve_multi(const Matrix& waves, OrtoWorkspace& ws);
+
+// То же по готовому разложению (например, из кэша разложений): e (n x T), R, norms
+void orto_solve_multi(const Matrix& waves,
+    const Eigen::Ref<const RowMatrix>& e,
+    const Eigen::Ref<const Matrix>& R,
+    const Eigen::Ref<const Vector>& norms,
+    OrtoWorkspace& ws);
+
+// Функция аппроксимации с заданным числом базисных функций (результат в ws.coefs и ws.rmse)
+using OrtoKernel = void (*)(const Vector& x, const Matrix& f_k, OrtoWorkspace& ws);
+
+// Версия approximate_with_non_orthogonal_basis_orto, собранная для фиксированного числа базисных функций
+// (6, 8, 9, 10, 12, 15, 16, 18, 20, 24, 25, 30, 36, 40, 48) с рабочими матрицами n x n на стеке.
+// Для остальных n_basis возвращается общая (динамическая) версия.
+OrtoKernel select_orto_kernel(int n_basis);
+
 // Обёртка для работы со стандартными векторами
 std::vector<double> approximate_with_non_orthogonal_basis_orto_std(
     const std::vector<double>& vector,
     const std::vector<std::vector<double>>& basis);
 
+// Аппроксимация через матрицу Грама G = f_k * f_k^T и правую часть f_k * x
+// (разложение Холецкого, при почти вырожденной G — LDL^T). RMSE — по энергии coefs^T * f_k * x
+Vector approximate_with_non_orthogonal_basis_gram(const Vector& x, const Matrix& f_k);
+void approximate_with_non_orthogonal_basis_gram(const Vector& x, const Matrix& f_k, OrtoWorkspace& ws);
+
+// То же для нескольких сигналов waves (T x k): одно разложение G, результат в ws.coefs_multi и ws.rmse_multi
+void approximate_with_non_orthogonal_basis_gram_multi(const Matrix& waves, const Matrix& f_k, OrtoWorkspace& ws);
+
 #endif // APPROX_ORTO_H
@@ -0,0 +1,67 @@
+#include "basis_support.h"
+#include <algorithm>
+#include <cmath>
+
+template <typename Scalar>
+BasisSupport compute_basis_support(Field4D<Scalar>& fk_data, double threshold) {
+    BasisSupport support;
+    if (fk_data.empty()) return support;
+    // Обнуление меняет данные, а представление отображённого файла только для чтения — нужна своя копия
+    if (threshold > 0 && !fk_data.owns_data()) {
+        fk_data = fk_data.compact_copy();
+    }
+    const int n_basis = fk_data.size(0);
+    const int T = fk_data.size(1);
+    const int height = fk_data.size(2);
+    const int width = fk_data.size(3);
+    support.region_height = height;
+    support.x_count = width;
+    support.n_basis = n_basis;
+    support.begin.assign(static_cast<size_t>(height) * width * n_basis, -1);
+    support.end.assign(static_cast<size_t>(height) * width * n_basis, 0);
+
+    // Порог значимости для каждого пикселя; проходы идут по t снаружи, как лежат данные в файлах
+    std::vector<double> cutoff(static_cast<size_t>(height) * width, 0.0);
+    for (int b = 0; b < n_basis; b++) {
+        TensorView<Scalar, 3> series = fk_data.slice(b);
+        if (threshold > 0) {
+            std::fill(cutoff.begin(), cutoff.end(), 0.0);
+            for (int t = 0; t < T; t++)
+                for (int i = 0; i < height; i++)
+                    for (int x = 0; x < width; x++) {
+                        double& c = cutoff[static_cast<size_t>(i) * width + x];
+                        c = std::max(c, static_cast<double>(std::abs(series(t, i, x))));
+                    }
+            for (double& c : cutoff) c *= threshold;
+        }
+
+        for (int t = 0; t < T; t++)
+            for (int i = 0; i < height; i++)
+                for (int x = 0; x < width; x++) {
+                    if (std::abs(series(t, i, x)) <= cutoff[static_cast<size_t>(i) * width + x]) continue;
+                    size_t k = support.offset(i, x) + b;
+                    if (support.begin[k] < 0) support.begin[k] = t;
+                    support.end[k] = t + 1;
+                }
+
+        for (int i = 0; i < height; i++)
+            for (int x = 0; x < width; x++) {
+                size_t k = support.offset(i, x) + b;
+                if (support.begin[k] < 0) support.begin[k] = 0;
+            }
+
+        // Обнуление отсчётов вне носителя (при нулевом пороге там и так нули)
+        if (threshold > 0) {
+            for (int t = 0; t < T; t++)
+                for (int i = 0; i < height; i++)
+                    for (int x = 0; x < width; x++) {
+                        size_t k = support.offset(i, x) + b;
+                        if (t < support.begin[k] || t >= support.end[k]) series(t, i, x) = 0;
+                    }
+        }
+    }
+    return support;
+}
+
+template BasisSupport compute_basis_support<double>(Field4D<double>&, double);
+template BasisSupport compute_basis_support<float>(Field4D<float>&, double);
@@ -0,0 +1,35 @@
+#ifndef BASIS_SUPPORT_H
+#define BASIS_SUPPORT_H
+
+#include <cstddef>
+#include <vector>
+#include "managers.h"
+
+// Носители базисных мариограмм. До прихода волны от своего источника ряд fk_data[b][.][i][x]
+// равен (или почти равен) нулю, поэтому скалярные произведения в ядрах достаточно считать
+// по пересечению носителей.
+//
+// Носитель ряда — отсчёты [begin, end) от первого до последнего значимого отсчёта;
+// пустой ряд — begin == end == 0.
+struct BasisSupport {
+    int region_height = 0;
+    int x_count = 0;
+    int n_basis = 0;
+    std::vector<int> begin; // [region_height][x_count][n_basis]
+    std::vector<int> end;
+
+    size_t offset(int i, int x) const {
+        return (static_cast<size_t>(i) * x_count + x) * n_basis;
+    }
+    const int* pixel_begin(int i, int x) const { return begin.data() + offset(i, x); }
+    const int* pixel_end(int i, int x) const { return end.data() + offset(i, x); }
+};
+
+// Носители всех рядов региона. Значимый отсчёт: |f| > threshold * max_t |f|.
+// Отсчёты вне носителя обнуляются, чтобы все решатели работали с одними и теми же данными;
+// при threshold = 0 отбрасываются только точные нули и данные не меняются.
+// Представление чужой памяти (Tensor::owns_data() == false) перед обнулением заменяется копией
+template <typename Scalar>
+BasisSupport compute_basis_support(Field4D<Scalar>& fk_data, double threshold);
+
+#endif // BASIS_SUPPORT_H
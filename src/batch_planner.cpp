@@ -0,0 +1,142 @@
+#include "batch_planner.h"
+#include <netcdf.h>
+#include <algorithm>
+#include <iostream>
+
+int inspect_storage(const NcVariable& variable, NcStorage& storage) {
+    storage = NcStorage();
+    storage.shape[0] = variable.T;
+    storage.shape[1] = variable.Y;
+    storage.shape[2] = variable.X;
+
+    NcLock nc_lock;
+    nc_type type;
+    int retval = nc_inq_vartype(variable.ncid, variable.varid, &type);
+    if (retval == NC_NOERR) {
+        retval = nc_inq_type(variable.ncid, type, nullptr, &storage.element_size);
+    }
+    if (retval != NC_NOERR) return retval;
+
+    int storage_kind;
+    retval = nc_inq_var_chunking(variable.ncid, variable.varid, &storage_kind, storage.chunk);
+    if (retval != NC_NOERR) return retval;
+    storage.chunked = storage_kind == NC_CHUNKED;
+
+    int shuffle, deflate;
+    retval = nc_inq_var_deflate(variable.ncid, variable.varid, &shuffle, &deflate, &storage.deflate_level);
+    if (retval != NC_NOERR) return retval;
+    storage.deflate = deflate != 0;
+    return NC_NOERR;
+}
+
+// Наименьшее простое число не меньше n (число ячеек хэш-таблицы кэша блоков)
+static size_t next_prime(size_t n) {
+    for (;; n++) {
+        bool prime = n > 1;
+        for (size_t d = 2; d * d <= n && prime; d++) {
+            if (n % d == 0) prime = false;
+        }
+        if (prime) return n;
+    }
+}
+
+// Число блоков размера chunk, в которые попадают count отсчётов first, first + stride, ...
+static size_t touched_chunks(int first, int count, int stride, size_t chunk) {
+    size_t touched = 0;
+    long long last_chunk = -1;
+    for (int k = 0; k < count; k++) {
+        long long c = (static_cast<long long>(first) + static_cast<long long>(k) * stride) / static_cast<long long>(chunk);
+        if (c != last_chunk) touched++;
+        last_chunk = c;
+    }
+    return touched;
+}
+
+BatchPlan plan_batches(const NcStorage& storage, const RegionOfInterest& roi, int batch_rows) {
+    BatchPlan plan;
+    // Область, обрезанная по размерам файла (если они известны)
+    RegionOfInterest region = roi;
+    if (storage.shape[1] > 0) region.y1 = std::min<int>(region.y1, static_cast<int>(storage.shape[1]));
+    if (storage.shape[2] > 0) region.x1 = std::min<int>(region.x1, static_cast<int>(storage.shape[2]));
+    if (storage.shape[0] > 0) region.t1 = std::min<int>(region.t1, static_cast<int>(storage.shape[0]));
+    if (region.empty() || batch_rows < 1) return plan;
+
+    const int sy = region.y_stride;
+    const int span = batch_rows * sy; // строк файла в пакете
+    const int cy = storage.chunked ? static_cast<int>(storage.chunk[1]) : 0;
+    // Первая строка сетки области, не меньшая y
+    auto on_grid = [&](int y) { return region.y0 + (y - region.y0 + sy - 1) / sy * sy; };
+
+    if (cy > 0 && span >= cy) {
+        plan.aligned = true;
+        const int aligned_span = std::max(cy, span / cy * cy);
+        for (int y = region.y0; y < region.y1;) {
+            int boundary = (y + aligned_span) / cy * cy;
+            if (boundary <= y) boundary = (y / cy + 1) * cy;
+            int end = std::min(on_grid(boundary), region.y1);
+            plan.batches.emplace_back(y, end);
+            y = end;
+        }
+    } else {
+        for (int y = region.y0; y < region.y1; y += span) {
+            plan.batches.emplace_back(y, std::min(y + span, region.y1));
+        }
+    }
+    if (!storage.chunked || cy == 0) return plan;
+
+    // Блоки, которые задевает одна строка блоков области (при шаге больше блока часть блоков пропускается)
+    const size_t ct = std::max<size_t>(1, storage.chunk[0]);
+    const size_t cx = std::max<size_t>(1, storage.chunk[2]);
+    if (region.duration() == 0) return plan;
+    const size_t chunks_in_row = touched_chunks(region.t0, region.duration(), region.t_stride, ct)
+        * touched_chunks(region.x0, region.width(), region.x_stride, cx);
+    const size_t row_elements = chunks_in_row * ct * storage.chunk[1] * cx;
+    const size_t row_bytes = row_elements * storage.element_size;
+
+    // Строка блоков, общая для соседних пакетов, распаковывается повторно, если не помещается в кэш
+    bool row_cached = row_bytes <= max_chunk_cache_bytes;
+    if (row_cached) {
+        plan.chunk_cache_bytes = row_bytes;
+        plan.chunk_cache_slots = next_prime(std::max<size_t>(1009, 10 * chunks_in_row));
+    }
+
+    double decompressed = 0;
+    long long previous_chunk_row = -1;
+    for (const auto& batch : plan.batches) {
+        long long last_counted = -1;
+        for (int y = batch.first; y < batch.second; y += sy) {
+            long long chunk_row = y / cy;
+            if (chunk_row == last_counted) continue;
+            last_counted = chunk_row;
+            if (chunk_row == previous_chunk_row && row_cached) continue;
+            decompressed += static_cast<double>(row_elements);
+        }
+        previous_chunk_row = last_counted;
+    }
+    double used = static_cast<double>(region.duration()) * region.width() * region.height();
+    plan.amplification = used > 0 ? decompressed / used : 1;
+    return plan;
+}
+
+void print_batch_plan(const NcStorage& storage, const BatchPlan& plan, int y_stride) {
+    const int sy = std::max(1, y_stride);
+    std::cout << "batch plan: ";
+    if (storage.chunked) {
+        std::cout << "chunks [" << storage.chunk[0] << ", " << storage.chunk[1] << ", " << storage.chunk[2] << "]";
+    } else {
+        std::cout << "contiguous";
+    }
+    if (storage.deflate) {
+        std::cout << ", deflate " << storage.deflate_level;
+    }
+    int max_rows = 0;
+    for (const auto& batch : plan.batches) {
+        max_rows = std::max(max_rows, (batch.second - batch.first + sy - 1) / sy);
+    }
+    std::cout << "; " << plan.batches.size() << " batches of up to " << max_rows << " rows"
+              << (plan.aligned ? " aligned to chunk rows" : "");
+    if (plan.chunk_cache_bytes > 0) {
+        std::cout << "; chunk cache " << plan.chunk_cache_bytes / double(1 << 20) << " MiB per file";
+    }
+    std::cout << "; expected read amplification " << plan.amplification << "\n";
+}
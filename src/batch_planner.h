@@ -0,0 +1,46 @@
+#ifndef BATCH_PLANNER_H
+#define BATCH_PLANNER_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include "nc_pool.h"
+#include "stable_data_structs.h"
+
+// Хранение переменной "height" в файле: блоки (chunks) HDF5 и сжатие.
+// Блок распаковывается целиком, даже если из него нужна одна строка, поэтому пакеты,
+// пересекающие границы блоков, читают с диска и распаковывают больше, чем используют
+struct NcStorage {
+    size_t shape[3] = { 0, 0, 0 }; // T, Y, X
+    bool chunked = false;
+    size_t chunk[3] = { 0, 0, 0 }; // размеры блока по t, y, x
+    bool deflate = false;
+    int deflate_level = 0;
+    size_t element_size = 8;       // байт на отсчёт в файле
+};
+
+// Разбор хранения переменной открытого файла. Возвращает NC_NOERR или код ошибки NetCDF
+int inspect_storage(const NcVariable& variable, NcStorage& storage);
+
+// Предел кэша блоков на одну переменную (кэш есть у каждого открытого файла)
+constexpr size_t max_chunk_cache_bytes = size_t(64) << 20;
+
+// План y-пакетов прохода по области расчёта
+struct BatchPlan {
+    std::vector<std::pair<int, int>> batches; // строки [y_start, y_end) пакетов в координатах файла
+    bool aligned = false;          // границы пакетов (кроме начала области) совпадают с границами блоков по y
+    size_t chunk_cache_bytes = 0;  // кэш блоков на переменную; 0 — оставить настройку NetCDF
+    size_t chunk_cache_slots = 0;
+    double amplification = 1;      // распаковано / использовано отсчётов за весь проход
+};
+
+// План пакетов по batch_rows строк области roi (с учётом шага по y). Если блоки по y не выше
+// пакета, пакет округляется вниз до целого числа строк блоков и границы выравниваются по ним;
+// иначе пакеты не выравниваются, а кэш блоков держит строку блоков, общую для соседних пакетов
+BatchPlan plan_batches(const NcStorage& storage, const RegionOfInterest& roi, int batch_rows);
+
+// Вывод плана: блоки, сжатие, число и высота пакетов (в строках области с шагом y_stride),
+// кэш и ожидаемое увеличение объёма чтения
+void print_batch_plan(const NcStorage& storage, const BatchPlan& plan, int y_stride);
+
+#endif // BATCH_PLANNER_H
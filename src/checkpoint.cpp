@@ -0,0 +1,198 @@
+#include "checkpoint.h"
+#include "fingerprint.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include "json.hpp"
+
+namespace fs = std::filesystem;
+
+static const char checkpoint_magic[8] = { 'T', 'S', 'C', 'K', 'P', 'T', '\0', '\0' };
+constexpr uint32_t checkpoint_version = 1;
+
+static std::string hex(uint64_t value) {
+    char text[17];
+    std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(value));
+    return text;
+}
+
+static uint64_t from_hex(const std::string& text) {
+    return static_cast<uint64_t>(std::strtoull(text.c_str(), nullptr, 16));
+}
+
+// Запись через временный файл и переименование: файл path либо прежний, либо целиком новый
+static bool write_atomically(const std::string& path, const char* data, size_t size) {
+    std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream ofs(tmp_path, std::ios::binary);
+        if (!ofs.is_open()) {
+            std::cerr << "Не удалось открыть файл " << tmp_path << " для записи.\n";
+            return false;
+        }
+        ofs.write(data, static_cast<std::streamsize>(size));
+        if (!ofs) {
+            std::cerr << "Ошибка записи файла " << tmp_path << "\n";
+            return false;
+        }
+    }
+    std::error_code ec;
+    fs::rename(tmp_path, path, ec);
+    if (ec) {
+        std::cerr << "Не удалось переименовать " << tmp_path << ": " << ec.message() << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool CheckpointStore::open(const std::string& dir, const std::string& job, uint64_t input_hash, bool resume) {
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    if (ec) {
+        std::cerr << "Не удалось создать папку контрольных точек " << dir << ": " << ec.message() << "\n";
+        return false;
+    }
+    dir_ = dir;
+    job_ = job;
+    input_hash_ = input_hash;
+    manifest_path_ = (fs::path(dir) / (job + ".manifest.json")).string();
+    entries_.clear();
+
+    std::ifstream ifs(manifest_path_);
+    if (resume && ifs.is_open()) {
+        nlohmann::json manifest = nlohmann::json::parse(ifs, nullptr, false);
+        if (manifest.is_discarded() || !manifest.contains("batches") || manifest.value("job", "") != job) {
+            std::cerr << "Манифест " << manifest_path_ << " повреждён, расчёт начинается заново" << std::endl;
+        } else if (from_hex(manifest.value("input_hash", "")) != input_hash) {
+            std::cout << "checkpoint: inputs changed since " << manifest_path_ << ", starting over\n";
+        } else {
+            for (const auto& batch : manifest["batches"]) {
+                if (!batch.is_object() || !batch.contains("y") || !batch["y"].is_array() || batch["y"].size() != 2) continue;
+                Entry entry;
+                entry.rows = batch.value("rows", 0);
+                entry.columns = batch.value("columns", 0);
+                entry.file = batch.value("file", "");
+                entry.content_hash = from_hex(batch.value("hash", ""));
+                entries_[{ batch["y"][0].get<int>(), batch["y"][1].get<int>() }] = entry;
+            }
+            std::cout << "checkpoint: " << entries_.size() << " batches done in " << manifest_path_ << "\n";
+        }
+    }
+    ifs.close();
+    // Манифест переписывается сразу: папка доступна для записи, а пакеты прежнего расчёта
+    // с другими входами из него убраны
+    std::lock_guard<std::mutex> lock(mutex_);
+    return write_manifest();
+}
+
+bool CheckpointStore::restore(int y_start, int y_end, CheckpointRows& rows) {
+    Entry entry;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find({ y_start, y_end });
+        if (it == entries_.end()) return false;
+        entry = it->second;
+    }
+    std::string path = (fs::path(dir_) / entry.file).string();
+    std::ifstream ifs(path, std::ios::binary);
+    std::vector<char> bytes;
+    if (ifs.is_open()) {
+        bytes.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    }
+    CheckpointHeader header;
+    bool valid = bytes.size() >= sizeof(header);
+    if (valid) {
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        valid = header.rows >= 0 && header.n_waves >= 0 && header.columns >= 0 && header.n_basis >= 0;
+    }
+    if (valid) {
+        size_t values = static_cast<size_t>(header.rows) * header.n_waves * header.columns * (header.n_basis + 1);
+        valid = std::memcmp(header.magic, checkpoint_magic, sizeof(header.magic)) == 0
+            && header.version == checkpoint_version && header.input_hash == input_hash_
+            && header.y_start == y_start && header.y_end == y_end
+            && header.rows == entry.rows && header.columns == entry.columns
+            && bytes.size() == sizeof(header) + values * sizeof(double)
+            && fingerprint_bytes(input_hash_, bytes.data(), bytes.size()) == entry.content_hash;
+    }
+    if (!valid) {
+        std::cerr << "Контрольная точка " << path << " повреждена, пакет считается заново" << std::endl;
+        return false;
+    }
+
+    const char* values = bytes.data() + sizeof(header);
+    rows.assign(header.rows, std::vector<std::vector<CoefficientData>>(header.n_waves, std::vector<CoefficientData>(header.columns)));
+    for (auto& row : rows) {
+        for (auto& wave_row : row) {
+            for (auto& pixel : wave_row) {
+                pixel.coefs.resize(header.n_basis);
+                std::memcpy(pixel.coefs.data(), values, header.n_basis * sizeof(double));
+                std::memcpy(&pixel.aprox_error, values + header.n_basis * sizeof(double), sizeof(double));
+                values += (header.n_basis + 1) * sizeof(double);
+            }
+        }
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    restored_++;
+    return true;
+}
+
+bool CheckpointStore::save(int y_start, int y_end, const CheckpointRows& rows) {
+    CheckpointHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, checkpoint_magic, sizeof(header.magic));
+    header.version = checkpoint_version;
+    header.y_start = y_start;
+    header.y_end = y_end;
+    header.rows = static_cast<int32_t>(rows.size());
+    header.n_waves = rows.empty() ? 0 : static_cast<int32_t>(rows[0].size());
+    header.columns = header.n_waves == 0 ? 0 : static_cast<int32_t>(rows[0][0].size());
+    header.n_basis = header.columns == 0 ? 0 : static_cast<int32_t>(rows[0][0][0].coefs.size());
+    header.input_hash = input_hash_;
+
+    std::vector<char> bytes(sizeof(header) + static_cast<size_t>(header.rows) * header.n_waves * header.columns
+        * (header.n_basis + 1) * sizeof(double));
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    char* values = bytes.data() + sizeof(header);
+    for (const auto& row : rows) {
+        for (const auto& wave_row : row) {
+            for (const auto& pixel : wave_row) {
+                std::memcpy(values, pixel.coefs.data(), header.n_basis * sizeof(double));
+                std::memcpy(values + header.n_basis * sizeof(double), &pixel.aprox_error, sizeof(double));
+                values += (header.n_basis + 1) * sizeof(double);
+            }
+        }
+    }
+
+    Entry entry;
+    entry.rows = header.rows;
+    entry.columns = header.columns;
+    entry.file = job_ + ".y" + std::to_string(y_start) + "-" + std::to_string(y_end) + ".ckpt";
+    entry.content_hash = fingerprint_bytes(input_hash_, bytes.data(), bytes.size());
+    if (!write_atomically((fs::path(dir_) / entry.file).string(), bytes.data(), bytes.size())) return false;
+
+    // Пакет вносится в манифест только после того, как его файл записан целиком
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_[{ y_start, y_end }] = entry;
+    saved_++;
+    return write_manifest();
+}
+
+bool CheckpointStore::write_manifest() {
+    nlohmann::json manifest;
+    manifest["job"] = job_;
+    manifest["input_hash"] = hex(input_hash_);
+    manifest["batches"] = nlohmann::json::array();
+    for (const auto& item : entries_) {
+        manifest["batches"].push_back({
+            {"y", {item.first.first, item.first.second}},
+            {"rows", item.second.rows},
+            {"columns", item.second.columns},
+            {"file", item.second.file},
+            {"hash", hex(item.second.content_hash)}
+        });
+    }
+    std::string text = manifest.dump(4);
+    return write_atomically(manifest_path_, text.data(), text.size());
+}
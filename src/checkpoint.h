@@ -0,0 +1,77 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "statistics.h"
+
+// Контрольные точки расчёта по y-пакетам (--checkpoint DIR, --resume).
+// Каждый решённый пакет сохраняется в свой файл <job>.y<y_start>-<y_end>.ckpt и вносится в манифест
+// <job>.manifest.json; и файл, и манифест пишутся во временный файл и переименовываются, поэтому
+// после сбоя в манифесте только целые пакеты. При возобновлении пакет из манифеста с теми же
+// входами (отпечаток input_hash) и неповреждённым файлом не читается и не решается.
+//
+// Файл пакета: CheckpointHeader, затем строки пакета подряд; в строке — сценарии, в сценарии —
+// пиксели по x, на пиксель double[n_basis + 1]: коэффициенты и ошибка аппроксимации
+
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    int32_t y_start;
+    int32_t y_end;
+    int32_t rows;
+    int32_t n_waves;
+    int32_t columns;
+    int32_t n_basis;
+    uint64_t input_hash;
+};
+
+// Строки пакета: rows[i][w][x]
+using CheckpointRows = std::vector<std::vector<std::vector<CoefficientData>>>;
+
+class CheckpointStore {
+public:
+    // dir — папка контрольных точек, job — имя расчёта (файлы разных расчётов в одной папке не
+    // пересекаются), input_hash — отпечаток всего, от чего зависит результат. resume — взять пакеты
+    // из манифеста прежнего запуска (если его входы те же); иначе манифест начинается заново
+    bool open(const std::string& dir, const std::string& job, uint64_t input_hash, bool resume);
+
+    bool is_open() const { return !dir_.empty(); }
+
+    // Пакет [y_start, y_end) уже посчитан: его строки — в rows. false — пакета нет в манифесте
+    // или файл повреждён (тогда пакет считается заново)
+    bool restore(int y_start, int y_end, CheckpointRows& rows);
+
+    // Сохранить решённый пакет и внести его в манифест
+    bool save(int y_start, int y_end, const CheckpointRows& rows);
+
+    size_t restored() const { return restored_; }
+    size_t saved() const { return saved_; }
+    const std::string& manifest_path() const { return manifest_path_; }
+
+private:
+    struct Entry {
+        int rows = 0;
+        int columns = 0;
+        std::string file;       // имя файла пакета в dir_
+        uint64_t content_hash = 0;
+    };
+
+    bool write_manifest();
+
+    std::string dir_;
+    std::string job_;
+    std::string manifest_path_;
+    uint64_t input_hash_ = 0;
+    // Чтение пакетов и запись идут из разных стадий конвейера
+    std::mutex mutex_;
+    std::map<std::pair<int, int>, Entry> entries_;
+    size_t restored_ = 0;
+    size_t saved_ = 0;
+};
+
+#endif // CHECKPOINT_H
@@ -0,0 +1,104 @@
+#include "factor_cache.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+static const char factor_cache_magic[8] = { 'T', 'S', 'F', 'A', 'C', 'T', '\0', '\0' };
+constexpr uint32_t factor_cache_version = 4;
+
+size_t factor_record_size(int n_basis, int T) {
+    return static_cast<size_t>(n_basis) * (n_basis + 1 + T);
+}
+
+std::string factor_cache_path(const std::string& cache_dir, const FactorCacheKey& key) {
+    std::string name = key.basis_name + "_y" + std::to_string(key.y_start) + "-" + std::to_string(key.y_end)
+        + "_x" + std::to_string(key.x_start) + "-" + std::to_string(key.x_start + (key.x_count - 1) * key.x_stride + 1);
+    if (key.x_stride != 1 || key.y_stride != 1) {
+        name += "_s" + std::to_string(key.y_stride) + "x" + std::to_string(key.x_stride);
+    }
+    name += "_T" + std::to_string(key.T);
+    if (key.t_start != 0 || key.t_stride != 1) {
+        name += "_t" + std::to_string(key.t_start) + "s" + std::to_string(key.t_stride);
+    }
+    if (key.element_size != sizeof(double)) {
+        name += "_f" + std::to_string(key.element_size * 8);
+    }
+    name += ".fact";
+    return (fs::path(cache_dir) / name).string();
+}
+
+static FactorCacheHeader make_header(const FactorCacheKey& key) {
+    FactorCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, factor_cache_magic, sizeof(header.magic));
+    header.version = factor_cache_version;
+    header.y_start = key.y_start;
+    header.y_end = key.y_end;
+    header.T = key.T;
+    header.n_basis = key.n_basis;
+    header.x_count = key.x_count;
+    header.region_height = key.region_height;
+    header.x_start = key.x_start;
+    header.x_stride = key.x_stride;
+    header.y_stride = key.y_stride;
+    header.t_start = key.t_start;
+    header.t_stride = key.t_stride;
+    header.element_size = key.element_size;
+    header.source_hash = key.source_hash;
+    return header;
+}
+
+bool write_factor_cache(const std::string& path, const FactorCacheKey& key, const std::vector<double>& records) {
+    std::error_code ec;
+    fs::create_directories(fs::path(path).parent_path(), ec);
+    std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream ofs(tmp_path, std::ios::binary);
+        if (!ofs.is_open()) {
+            std::cerr << "Не удалось открыть файл " << tmp_path << " для записи.\n";
+            return false;
+        }
+        FactorCacheHeader header = make_header(key);
+        ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        ofs.write(reinterpret_cast<const char*>(records.data()), static_cast<std::streamsize>(records.size() * sizeof(double)));
+        if (!ofs) {
+            std::cerr << "Ошибка записи файла " << tmp_path << "\n";
+            return false;
+        }
+    }
+    fs::rename(tmp_path, path, ec);
+    if (ec) {
+        std::cerr << "Не удалось переименовать " << tmp_path << ": " << ec.message() << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool FactorCacheReader::open(const std::string& path, const FactorCacheKey& key) {
+    records_ = nullptr;
+    if (!fs::exists(path) || !file_.open(path)) return false;
+    size_t expected = sizeof(FactorCacheHeader)
+        + static_cast<size_t>(key.region_height) * key.x_count * factor_record_size(key.n_basis, key.T) * sizeof(double);
+    FactorCacheHeader header;
+    if (file_.size() != expected) {
+        file_.close();
+        return false;
+    }
+    std::memcpy(&header, file_.data(), sizeof(header));
+    FactorCacheHeader wanted = make_header(key);
+    if (std::memcmp(&header, &wanted, sizeof(header)) != 0) {
+        std::cout << "factor cache is stale: " << path << "\n";
+        file_.close();
+        return false;
+    }
+    key_ = key;
+    records_ = reinterpret_cast<const double*>(file_.data() + sizeof(FactorCacheHeader));
+    return true;
+}
+
+const double* FactorCacheReader::record(int i, int x) const {
+    return records_ + (static_cast<size_t>(i) * key_.x_count + x) * factor_record_size(key_.n_basis, key_.T);
+}
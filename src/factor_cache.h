@@ -0,0 +1,79 @@
+#ifndef FACTOR_CACHE_H
+#define FACTOR_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "mapped_file.h"
+
+// Кэш разложений базиса по пикселям для одного y-пакета.
+// Разложение зависит только от папки basis и региона, но не от wave, поэтому при повторных
+// запусках с новым сценарием basis-файлы не читаются: остаются только проекции.
+//
+// Файл: FactorCacheHeader, затем записи пикселей подряд (строка i, затем x), каждая запись —
+// double[factor_record_size(n_basis, T)]:
+//   R     [n_basis][n_basis] — треугольный множитель ортогонализации (по столбцам, как Eigen::MatrixXd)
+//   norms [n_basis]          — квадраты норм <e_i, e_i>
+//   e     [n_basis][T]       — ортогональный базис (по строкам)
+
+// Ключ разложения: всё, от чего оно зависит
+struct FactorCacheKey {
+    std::string basis_name;  // имя папки basis
+    int y_start = 0;
+    int y_end = 0;
+    int T = 0;
+    int n_basis = 0;
+    int x_count = 0;         // число пикселей в строке
+    int region_height = 0;   // число строк в пакете
+    int x_start = 0;         // первый столбец области расчёта
+    int x_stride = 1;        // шаги области расчёта по x и y
+    int y_stride = 1;
+    int t_start = 0;         // временное окно: первый отсчёт и шаг (число отсчётов — T)
+    int t_stride = 1;
+    int element_size = 8;    // байт на отсчёт basis при разложении: во float разложение строится по округлённым данным
+    uint64_t source_hash = 0; // отпечаток basis-файлов (fingerprint_files)
+};
+
+struct FactorCacheHeader {
+    char magic[8];
+    uint32_t version;
+    int32_t y_start;
+    int32_t y_end;
+    int32_t T;
+    int32_t n_basis;
+    int32_t x_count;
+    int32_t region_height;
+    int32_t x_start;
+    int32_t x_stride;
+    int32_t y_stride;
+    int32_t t_start;
+    int32_t t_stride;
+    int32_t element_size;
+    uint64_t source_hash;
+};
+
+// Размер записи одного пикселя в double
+size_t factor_record_size(int n_basis, int T);
+
+// Путь к файлу кэша пакета в папке cache_dir
+std::string factor_cache_path(const std::string& cache_dir, const FactorCacheKey& key);
+
+// Запись кэша (через временный файл и переименование); records — все записи пакета подряд
+bool write_factor_cache(const std::string& path, const FactorCacheKey& key, const std::vector<double>& records);
+
+// Чтение кэша через отображение файла в память
+class FactorCacheReader {
+public:
+    // Открыть файл и проверить, что он построен для того же ключа
+    bool open(const std::string& path, const FactorCacheKey& key);
+
+    // Запись пикселя (i, x)
+    const double* record(int i, int x) const;
+
+private:
+    MappedFile file_;
+    FactorCacheKey key_;
+    const double* records_ = nullptr;
+};
+
+#endif // FACTOR_CACHE_H
@@ -0,0 +1,127 @@
+#include "fingerprint.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+constexpr uint64_t fnv_offset = 14695981039346656037ull;
+constexpr uint64_t fnv_prime = 1099511628211ull;
+
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= fnv_prime;
+    }
+    return hash;
+}
+
+static long process_id() {
+#ifdef _WIN32
+    return static_cast<long>(_getpid());
+#else
+    return static_cast<long>(getpid());
+#endif
+}
+
+// Хеш всего содержимого файла
+static uint64_t hash_content(std::ifstream& ifs) {
+    constexpr size_t block_size = 1 << 20;
+    std::vector<char> block(block_size);
+    uint64_t hash = fnv_offset;
+    while (ifs.read(block.data(), static_cast<std::streamsize>(block_size)) || ifs.gcount() > 0) {
+        hash = fnv1a(hash, block.data(), static_cast<size_t>(ifs.gcount()));
+    }
+    return hash;
+}
+
+uint64_t fingerprint_file(const std::filesystem::path& file) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    uint64_t size = fs::file_size(file, ec);
+    if (ec) return 0;
+    int64_t mtime = static_cast<int64_t>(fs::last_write_time(file, ec).time_since_epoch().count());
+    if (ec) return 0;
+
+    // Хеш содержимого, посчитанный раньше для файла того же размера и времени изменения
+    static std::mutex mutex;
+    static std::map<std::string, std::tuple<uint64_t, int64_t, uint64_t>> memo;
+    std::string key = fs::absolute(file, ec).string();
+    fs::path sidecar = file.string() + ".fingerprint";
+    uint64_t content = 0;
+    bool known = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = memo.find(key);
+        if (it != memo.end() && std::get<0>(it->second) == size && std::get<1>(it->second) == mtime) {
+            content = std::get<2>(it->second);
+            known = true;
+        }
+    }
+    if (!known) {
+        std::ifstream cached(sidecar);
+        uint64_t cached_size = 0;
+        int64_t cached_mtime = 0;
+        std::string cached_hash;
+        if (cached >> cached_size >> cached_mtime >> cached_hash && cached_size == size && cached_mtime == mtime
+            && cached_hash.size() == 16 && cached_hash.find_first_not_of("0123456789abcdef") == std::string::npos) {
+            content = std::strtoull(cached_hash.c_str(), nullptr, 16);
+            known = true;
+        }
+    }
+    if (!known) {
+        std::ifstream ifs(file, std::ios::binary);
+        if (!ifs.is_open()) return 0;
+        content = hash_content(ifs);
+        // Запись через временный файл и переименование: процессы, считающие отпечаток той же папки
+        // одновременно (части --shard), не видят недописанный файл. Папка с данными может быть только
+        // для чтения: тогда хеш считается заново при каждом запуске
+        static std::atomic<unsigned> tmp_counter{ 0 };
+        std::string tmp_path = sidecar.string() + ".tmp." + std::to_string(process_id()) + "." + std::to_string(tmp_counter++);
+        bool written = false;
+        {
+            std::ofstream out(tmp_path);
+            if (out.is_open()) {
+                char text[17];
+                std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(content));
+                out << size << " " << mtime << " " << text << "\n";
+                written = static_cast<bool>(out);
+            }
+        }
+        std::error_code rename_ec;
+        if (written) fs::rename(tmp_path, sidecar, rename_ec);
+        if (!written || rename_ec) fs::remove(tmp_path, rename_ec);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        memo[key] = std::make_tuple(size, mtime, content);
+    }
+
+    std::string name = file.filename().string();
+    uint64_t hash = fnv1a(fnv_offset, name.data(), name.size());
+    hash = fnv1a(hash, &size, sizeof(size));
+    return fnv1a(hash, &content, sizeof(content));
+}
+
+uint64_t fingerprint_files(const std::vector<std::filesystem::path>& files) {
+    uint64_t hash = fnv_offset;
+    for (const auto& file : files) {
+        uint64_t file_hash = fingerprint_file(file);
+        hash = fnv1a(hash, &file_hash, sizeof(file_hash));
+    }
+    return hash;
+}
+
+uint64_t fingerprint_bytes(uint64_t hash, const void* data, size_t size) {
+    return fnv1a(hash, data, size);
+}
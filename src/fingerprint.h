@@ -0,0 +1,20 @@
+#ifndef FINGERPRINT_H
+#define FINGERPRINT_H
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// Отпечаток содержимого файла: FNV-1a по имени, размеру и хешу всего содержимого; 0 — файл не
+// удалось прочитать. Хеш содержимого дорог для многогигабайтных NetCDF, поэтому он запоминается
+// вместе с размером и временем изменения файла — в памяти процесса и в соседнем файле
+// <file>.fingerprint — и пересчитывается, только когда размер или время изменения другие
+uint64_t fingerprint_file(const std::filesystem::path& file);
+
+// Общий отпечаток набора файлов с учётом их порядка
+uint64_t fingerprint_files(const std::vector<std::filesystem::path>& files);
+
+// Добавить к отпечатку hash произвольные байты (например, параметры, от которых зависит результат)
+uint64_t fingerprint_bytes(uint64_t hash, const void* data, size_t size);
+
+#endif // FINGERPRINT_H
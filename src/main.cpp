@@ -1,10 +1,21 @@
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <cstdlib>
 #include <filesystem>
+#include <fstream>
+#include <chrono>
 #include <Eigen/Dense>
 #include "approx_orto.h"
+#include "approx_batch.h"
 #include "stable_data_structs.h"
 #include "statistics.h"
+#include "packed_basis.h"
+#include "memory_budget.h"
+#include "pipeline.h"
+#include "checkpoint.h"
+#include "fingerprint.h"
+#include <thread>
 
 // Для удобства
 namespace fs = std::filesystem;
@@ -78,7 +89,8 @@ int runWithPrePost(const std::string& root_folder,
     const std::string& bath,
     const std::string& wave,
     const std::string& basis,
-    const AreaConfigurationInfo& area_config) {
+    const AreaConfigurationInfo& area_config,
+    const StatisticsOptions& options) {
     // Формируем пути для копирования папки basis
     std::string sourceBasisFolder = root_folder + "/" + bath + "/" + basis;
     std::string destBathFolder = cache_folder + "/" + bath;
@@ -110,7 +122,7 @@ int runWithPrePost(const std::string& root_folder,
     }
 
     // Выполняем основную функцию
-    save_and_plot_statistics(cache_folder, bath, wave, basis, area_config);
+    save_and_plot_statistics(cache_folder, bath, wave, basis, area_config, options);
 
     // Удаляем скопированную папку basis из кэша
     if (!deleteFolder(destBasisFolder)) {
@@ -126,15 +138,107 @@ int runWithPrePost(const std::string& root_folder,
 
     return 0;
 }
+// Разбор диапазона "начало:конец[:шаг]"
+static bool parse_range(const std::string& text, int& begin, int& end, int& stride) {
+    int values[3] = { 0, 0, 1 };
+    int count = 0;
+    size_t pos = 0;
+    while (count < 3) {
+        size_t next = text.find(':', pos);
+        std::string part = text.substr(pos, next == std::string::npos ? std::string::npos : next - pos);
+        try {
+            size_t used = 0;
+            values[count++] = std::stoi(part, &used);
+            if (used != part.size()) return false;
+        }
+        catch (const std::exception&) {
+            return false;
+        }
+        if (next == std::string::npos) break;
+        pos = next + 1;
+    }
+    if (count < 2 || values[2] < 1 || values[1] <= values[0]) return false;
+    begin = values[0];
+    end = values[1];
+    stride = values[2];
+    return true;
+}
+
+// Разбор объёма памяти: число байт с необязательным суффиксом K, M, G или T (степени 1024), например "48G"
+static bool parse_size(const std::string& text, size_t& bytes) {
+    double value = 0;
+    size_t used = 0;
+    try {
+        value = std::stod(text, &used);
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+    std::string suffix = text.substr(used);
+    double scale = 1;
+    if (suffix == "K" || suffix == "k") scale = 1024.0;
+    else if (suffix == "M" || suffix == "m") scale = 1024.0 * 1024;
+    else if (suffix == "G" || suffix == "g") scale = 1024.0 * 1024 * 1024;
+    else if (suffix == "T" || suffix == "t") scale = 1024.0 * 1024 * 1024 * 1024;
+    else if (!suffix.empty()) return false;
+    if (value <= 0) return false;
+    bytes = static_cast<size_t>(value * scale);
+    return true;
+}
+
+// Разбор формы плитки "ширинаxстроки", например "8x4"
+static bool parse_tile(const std::string& text, int& width, int& rows) {
+    size_t separator = text.find('x');
+    if (separator == std::string::npos) return false;
+    try {
+        size_t used_width = 0, used_rows = 0;
+        int w = std::stoi(text.substr(0, separator), &used_width);
+        int r = std::stoi(text.substr(separator + 1), &used_rows);
+        if (used_width != separator || used_rows != text.size() - separator - 1 || w < 1 || r < 1) return false;
+        width = w;
+        rows = r;
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+// Разбор части расчёта "k/N" (k от 0)
+static bool parse_shard(const std::string& text, int& index, int& count) {
+    size_t slash = text.find('/');
+    if (slash == std::string::npos) return false;
+    try {
+        size_t used_index = 0, used_count = 0;
+        int k = std::stoi(text.substr(0, slash), &used_index);
+        int n = std::stoi(text.substr(slash + 1), &used_count);
+        if (used_index != slash || used_count != text.size() - slash - 1 || n < 1 || k < 0 || k >= n) return false;
+        index = k;
+        count = n;
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+// Разбор области "x0:x1[:sx],y0:y1[:sy]"
+static bool parse_region(const std::string& text, RegionOfInterest& region) {
+    size_t comma = text.find(',');
+    if (comma == std::string::npos) return false;
+    return parse_range(text.substr(0, comma), region.x0, region.x1, region.x_stride)
+        && parse_range(text.substr(comma + 1), region.y0, region.y1, region.y_stride);
+}
+
 // Функция для проведения тестов
 void run_tests() {
     // Размерности для тестовых случаев
-    std::vector<int> dimensions = { 3, 4, 5, 6, 8 };
+    std::vector<int> dimensions = { 1, 2, 3, 4, 5, 6, 8 };
     // Порог допуска (например, 1e-6)
     double tol = 1e-6;
     bool all_passed = true;
 
-    std::cout << "tests (approximate_with_non_orthogonal_basis_orto):\n";
+    std::cout << "tests (approximate_with_non_orthogonal_basis_orto / _gram):\n";
 
     for (int n : dimensions) {
         // Генерируем случайную квадратную матрицу n x n,
@@ -165,6 +269,552 @@ void run_tests() {
             std::cout << " [FAILED]\n";
             all_passed = false;
         }
+
+        // То же для версии, специализированной под n базисных функций
+        OrtoWorkspace workspace;
+        select_orto_kernel(n)(x, M, workspace);
+        Eigen::VectorXd b_fixed = workspace.coefs;
+        double error_fixed = (b_fixed - c).norm();
+        std::cout << "dim " << n << " (fixed): err = " << error_fixed;
+        if (error_fixed < tol) {
+            std::cout << " [PASSED]\n";
+        }
+        else {
+            std::cout << " [FAILED]\n";
+            all_passed = false;
+        }
+
+        // То же для решателя через матрицу Грама
+        Eigen::VectorXd b_gram = approximate_with_non_orthogonal_basis_gram(x, M);
+        double error_gram = (b_gram - c).norm();
+        std::cout << "dim " << n << " (gram): err = " << error_gram;
+        if (error_gram < tol) {
+            std::cout << " [PASSED]\n";
+        }
+        else {
+            std::cout << " [FAILED]\n";
+            all_passed = false;
+        }
+    }
+
+    // Решение для нескольких сигналов с одним разложением базиса (orto и gram)
+    {
+        const int n = 6, T = 30, k = 3;
+        Eigen::MatrixXd M = Eigen::MatrixXd::Random(n, T);
+        Eigen::MatrixXd waves = Eigen::MatrixXd::Random(T, k);
+        OrtoWorkspace workspace;
+        orto_factor(M, workspace);
+        orto_solve_multi(waves, workspace);
+        Eigen::MatrixXd coefs_orto = workspace.coefs_multi;
+        approximate_with_non_orthogonal_basis_gram_multi(waves, M, workspace);
+        double error = 0;
+        for (int w = 0; w < k; w++) {
+            Eigen::VectorXd expected = approximate_with_non_orthogonal_basis_orto(waves.col(w), M);
+            error = std::max(error, (coefs_orto.col(w) - expected).norm());
+            error = std::max(error, (workspace.coefs_multi.col(w) - expected).norm());
+        }
+        std::cout << "multi-wave " << k << " signals: err = " << error;
+        if (error < tol) {
+            std::cout << " [PASSED]\n";
+        }
+        else {
+            std::cout << " [FAILED]\n";
+            all_passed = false;
+        }
+    }
+
+    // Пакетный решатель должен совпадать с поштучным для каждого пикселя пакета
+    for (int lanes : { 4, 8, 16 }) {
+        const int n = 6, T = 40;
+        BatchBuffers<double> batch;
+        batch.reserve(n, T, lanes);
+        std::vector<Eigen::MatrixXd> pixel_basis(lanes);
+        std::vector<Eigen::VectorXd> pixel_wave(lanes);
+        for (int l = 0; l < lanes; l++) {
+            pixel_basis[l] = Eigen::MatrixXd::Random(n, T);
+            pixel_wave[l] = Eigen::VectorXd::Random(T);
+            for (int t = 0; t < T; t++) {
+                batch.wave[t * lanes + l] = pixel_wave[l][t];
+                for (int b = 0; b < n; b++) batch.basis[(b * T + t) * lanes + l] = pixel_basis[l](b, t);
+            }
+        }
+        approximate_batch_orto(n, T, batch);
+        double error = 0;
+        for (int l = 0; l < lanes; l++) {
+            Eigen::VectorXd expected = approximate_with_non_orthogonal_basis_orto(pixel_wave[l], pixel_basis[l]);
+            double expected_rmse = std::sqrt((pixel_wave[l] - pixel_basis[l].transpose() * expected).squaredNorm() / T);
+            for (int b = 0; b < n; b++) error = std::max(error, std::abs(batch.coefs[b * lanes + l] - expected[b]));
+            error = std::max(error, std::abs(batch.rmse[l] - expected_rmse));
+        }
+        std::cout << "batch " << lanes << " lanes: err = " << error;
+        if (error < tol) {
+            std::cout << " [PASSED]\n";
+        }
+        else {
+            std::cout << " [FAILED]\n";
+            all_passed = false;
+        }
+    }
+
+    // RMSE по энергии проекций должна совпадать с явным остатком, в том числе при точном
+    // представлении сигнала (полное сокращение, срабатывает явный остаток)
+    {
+        const int n = 6, T = 50;
+        Eigen::MatrixXd M = Eigen::MatrixXd::Random(n, T);
+        double error = 0;
+        for (Eigen::VectorXd x : { Eigen::VectorXd(Eigen::VectorXd::Random(T)), Eigen::VectorXd(M.transpose() * Eigen::VectorXd::Random(n)) }) {
+            OrtoWorkspace workspace;
+            approximate_with_non_orthogonal_basis_orto(x, M, workspace);
+            double expected = std::sqrt((x - M.transpose() * workspace.coefs).squaredNorm() / T);
+            error = std::max(error, std::abs(workspace.rmse - expected));
+            approximate_with_non_orthogonal_basis_gram(x, M, workspace);
+            expected = std::sqrt((x - M.transpose() * workspace.coefs).squaredNorm() / T);
+            error = std::max(error, std::abs(workspace.rmse - expected));
+        }
+        std::cout << "fused rmse: err = " << error;
+        if (error < tol) {
+            std::cout << " [PASSED]\n";
+        }
+        else {
+            std::cout << " [FAILED]\n";
+            all_passed = false;
+        }
+    }
+
+    // Базис с носителями (нули до прихода волны и после затухания): ядра, считающие
+    // произведения по пересечению носителей, с перестановкой по носителям и без неё
+    // должны совпадать с полным расчётом
+    {
+        const int n = 6, T = 60, lanes = 4;
+        BatchBuffers<double> batch;
+        batch.reserve(n, T, lanes);
+        double error = 0;
+        for (int l = 0; l < lanes; l++) {
+            Eigen::MatrixXd M = Eigen::MatrixXd::Random(n, T);
+            Eigen::VectorXd x = Eigen::VectorXd::Random(T);
+            OrtoWorkspace workspace;
+            workspace.reserve(n, T);
+            for (int b = 0; b < n; b++) {
+                int begin = (b * 7 + l) % 30, end = T - (b * 3) % 10;
+                M.row(b).head(begin).setZero();
+                M.row(b).tail(T - end).setZero();
+                workspace.support_begin[b] = begin;
+                workspace.support_end[b] = end;
+                batch.support_begin[b] = (l == 0) ? begin : std::min(batch.support_begin[b], begin);
+                batch.support_end[b] = (l == 0) ? end : std::max(batch.support_end[b], end);
+                for (int t = 0; t < T; t++) batch.basis[(b * T + t) * lanes + l] = M(b, t);
+            }
+            for (int t = 0; t < T; t++) batch.wave[t * lanes + l] = x[t];
+            Eigen::VectorXd expected = approximate_with_non_orthogonal_basis_orto(x, M);
+            approximate_with_non_orthogonal_basis_orto(x, M, workspace);
+            error = std::max(error, (workspace.coefs - expected).norm());
+            workspace.reorder_by_support = true;
+            select_orto_kernel(n)(x, M, workspace);
+            error = std::max(error, (workspace.coefs - expected).norm());
+            approximate_with_non_orthogonal_basis_gram(x, M, workspace);
+            error = std::max(error, (workspace.coefs - expected).norm());
+        }
+        for (bool reorder : { false, true }) {
+            batch.reorder_by_support = reorder;
+            approximate_batch_orto(n, T, batch);
+            for (int l = 0; l < lanes; l++) {
+                Eigen::MatrixXd M(n, T);
+                Eigen::VectorXd x(T);
+                for (int t = 0; t < T; t++) {
+                    x[t] = batch.wave[t * lanes + l];
+                    for (int b = 0; b < n; b++) M(b, t) = batch.basis[(b * T + t) * lanes + l];
+                }
+                Eigen::VectorXd expected = approximate_with_non_orthogonal_basis_orto(x, M);
+                for (int b = 0; b < n; b++) error = std::max(error, std::abs(batch.coefs[b * lanes + l] - expected[b]));
+            }
+        }
+        std::cout << "basis support: err = " << error;
+        if (error < tol) {
+            std::cout << " [PASSED]\n";
+        }
+        else {
+            std::cout << " [FAILED]\n";
+            all_passed = false;
+        }
+    }
+
+    // Разбор области расчёта из командной строки: размеры с учётом шагов
+    {
+        RegionOfInterest region;
+        int error = 0;
+        if (!parse_region("4:36:2,75:100", region)) error++;
+        if (region.x0 != 4 || region.x1 != 36 || region.x_stride != 2 || region.width() != 16) error++;
+        if (region.y0 != 75 || region.y1 != 100 || region.y_stride != 1 || region.height() != 25) error++;
+        if (region.rows(80, 90).height() != 10 || region.rows(80, 90).width() != 16) error++;
+        if (parse_region("4:36", region) || parse_region("4:36:0,0:1", region) || parse_region("a:b,0:1", region)) error++;
+        // Временное окно: число отсчётов с шагом, обрезка по длине записи
+        if (!parse_range("10:200:3", region.t0, region.t1, region.t_stride) || region.duration() != 64) error++;
+        RegionOfInterest clipped;
+        if (!clip_to_shape(region, 100, 500, 40, clipped) || clipped.duration() != 30 || clipped.width() != 16) error++;
+        if (RegionOfInterest().with_time_of(region).duration() != 64) error++;
+        // Части расчёта: строки области делятся без пропусков и наложений
+        int shard_index = 0, shard_count = 0;
+        if (!parse_shard("2/3", shard_index, shard_count) || shard_index != 2 || shard_count != 3) error++;
+        if (parse_shard("3/3", shard_index, shard_count) || parse_shard("1", shard_index, shard_count)) error++;
+        RegionOfInterest full{ 0, 8, 75, 100, 1, 2 };
+        int next_y = full.y0, shard_rows = 0;
+        for (int k = 0; k < 4; k++) {
+            RegionOfInterest part = full.shard(k, 4);
+            if (part.y0 != next_y) error++;
+            next_y = part.y1;
+            shard_rows += part.height();
+        }
+        if (shard_rows != full.height() || full.shard(4, 5).height() != 3) error++;
+        // Форма плитки
+        int tile_width = 0, tile_rows = 0;
+        if (!parse_tile("16x4", tile_width, tile_rows) || tile_width != 16 || tile_rows != 4) error++;
+        if (parse_tile("16", tile_width, tile_rows) || parse_tile("0x4", tile_width, tile_rows) || parse_tile("8x4x2", tile_width, tile_rows)) error++;
+        std::cout << "roi parse: err = " << error;
+        if (error == 0) {
+            std::cout << " [PASSED]\n";
+        }
+        else {
+            std::cout << " [FAILED]\n";
+            all_passed = false;
+        }
+    }
+
+    // План пакетов по блокам: границы на строках блоков, покрытие без пропусков,
+    // увеличение объёма чтения при шаге по x через блоки во всю ширину и при шаге по t
+    {
+        NcStorage storage;
+        storage.shape[0] = 100; storage.shape[1] = 500; storage.shape[2] = 40;
+        storage.chunked = true;
+        storage.chunk[0] = 1; storage.chunk[1] = 50; storage.chunk[2] = 40;
+        RegionOfInterest region{ 0, 40, 75, 500 };
+        BatchPlan plan = plan_batches(storage, region, 192);
+        int error = plan.aligned ? 0 : 1;
+        int y = region.y0;
+        for (const auto& batch : plan.batches) {
+            if (batch.first != y || batch.second - batch.first > 192) error++;
+            if (batch.second != region.y1 && batch.second % 50 != 0) error++;
+            y = batch.second;
+        }
+        if (y != region.y1) error++;
+        region.y0 = 0;
+        if (std::abs(plan_batches(storage, region, 192).amplification - 1) > 1e-12) error++;
+        region.x_stride = 2;
+        if (std::abs(plan_batches(storage, region, 192).amplification - 2) > 1e-12) error++;
+        // Прореживание по t через блоки в один отсчёт не добавляет лишнего чтения
+        region.t_stride = 3;
+        if (std::abs(plan_batches(storage, region, 192).amplification - 2) > 1e-12) error++;
+        std::cout << "batch plan: err = " << error;
+        if (error == 0) {
+            std::cout << " [PASSED]\n";
+        }
+        else {
+            std::cout << " [FAILED]\n";
+            all_passed = false;
+        }
+    }
+
+    // Представление чужой памяти с шагами (как у упакованного basis) и его плотная копия
+    {
+        std::array<size_t, 4> shape = { 3, 5, 4, 6 };
+        Field4D<double> fk(shape, basis_strides(shape, BasisLayout::PixelMajor));
+        for (size_t b = 0; b < 3; b++)
+            for (size_t t = 0; t < 5; t++)
+                for (size_t i = 0; i < 4; i++)
+                    for (size_t x = 0; x < 6; x++) fk(b, t, i, x) = b + 10.0 * t + 100.0 * i + 1000.0 * x;
+        // Каждая вторая строка и каждый третий столбец без копирования
+        std::array<size_t, 4> strides = { fk.stride(0), fk.stride(1), 2 * fk.stride(2), 3 * fk.stride(3) };
+        Field4D<double> view(fk.data(), { 3, 5, 2, 2 }, strides, nullptr);
+        Field4D<double> copy = view.compact_copy();
+        double error = (view.owns_data() || !copy.owns_data() || copy.stride(0) != 1) ? 1 : 0;
+        for (size_t b = 0; b < 3; b++)
+            for (size_t t = 0; t < 5; t++)
+                for (size_t i = 0; i < 2; i++)
+                    for (size_t x = 0; x < 2; x++) {
+                        error = std::max(error, std::abs(view(b, t, i, x) - fk(b, t, 2 * i, 3 * x)));
+                        error = std::max(error, std::abs(copy(b, t, i, x) - fk(b, t, 2 * i, 3 * x)));
+                    }
+        std::cout << "tensor view: err = " << error;
+        if (error < tol) {
+            std::cout << " [PASSED]\n";
+        }
+        else {
+            std::cout << " [FAILED]\n";
+            all_passed = false;
+        }
+    }
+
+    // Бюджет памяти: разбор размера, высота пакета по оценке и её монотонность
+    {
+        int error = 0;
+        size_t bytes = 0;
+        if (!parse_size("48G", bytes) || bytes != (size_t(48) << 30)) error++;
+        if (!parse_size("1.5M", bytes) || bytes != (size_t(3) << 19)) error++;
+        if (parse_size("12X", bytes) || parse_size("-1G", bytes) || parse_size("G", bytes)) error++;
+        MemoryModel model;
+        model.n_basis = 24; model.T = 2000; model.width = 500; model.height = 1000;
+        MemoryFootprint footprint = estimate_footprint(model);
+        size_t budget = size_t(8) << 30;
+        int rows = rows_for_budget(footprint, budget, 1000);
+        if (rows < 1 || footprint.bytes(rows) > budget || (rows < 1000 && footprint.bytes(rows + 1) <= budget)) error++;
+        // Результат, записываемый по пакетам, не копится: постоянная часть меньше
+        model.stream_results = true;
+        if (estimate_footprint(model).fixed >= footprint.fixed) error++;
+        model.stream_results = false;
+        // Без конвейера в памяти один пакет — строк помещается больше; в float — ещё больше
+        model.queue_depth = 0;
+        int rows_single = rows_for_budget(estimate_footprint(model), budget, 1000);
+        model.element_size = sizeof(float);
+        if (rows_single <= rows || rows_for_budget(estimate_footprint(model), budget, 1000) <= rows_single) error++;
+        if (rows_for_budget(footprint, 1, 1000) != 1 || rows_for_budget(footprint, size_t(1) << 50, 1000) != 1000) error++;
+        std::cout << "memory budget: err = " << error;
+        if (error == 0) {
+            std::cout << " [PASSED]\n";
+        }
+        else {
+            std::cout << " [FAILED]\n";
+            all_passed = false;
+        }
+    }
+
+    // Пул потоков: каждая задача выполняется ровно один раз, пул переиспользуется между вызовами
+    {
+        ThreadPool pool(3);
+        int error = 0;
+        for (int round = 0; round < 2; round++) {
+            std::vector<int> hits(1000, 0);
+            pool.parallel_for(hits.size(), [&hits](size_t k) { hits[k]++; });
+            if (std::count(hits.begin(), hits.end(), 1) != 1000) error++;
+        }
+        size_t tasks = 0;
+        for (const auto& worker : pool.stats()) tasks += worker.tasks;
+        if (pool.size() != 3 || tasks != 2000) error++;
+        std::cout << "thread pool: err = " << error;
+        if (error == 0) {
+            std::cout << " [PASSED]\n";
+        }
+        else {
+            std::cout << " [FAILED]\n";
+            all_passed = false;
+        }
+    }
+
+    // Конвейер: очередь отдаёт элементы по порядку и не держит больше ёмкости;
+    // перестановка basis в PixelMajor сохраняет значения по логическим индексам
+    {
+        int error = 0;
+        BoundedQueue<int> queue("test", 2);
+        std::thread producer([&queue]() {
+            for (int k = 0; k < 100; k++) queue.push(k);
+            queue.close();
+        });
+        int value = 0, expected = 0;
+        while (queue.pop(value)) {
+            if (value != expected++) error++;
+        }
+        producer.join();
+        QueueStats stats = queue.stats();
+        if (expected != 100 || stats.pushed != 100 || stats.max_size > 2 || stats.max_size < 1) error++;
+
+        std::array<size_t, 4> shape = { 3, 5, 2, 7 };
+        Field4D<float> fk(shape, basis_strides(shape, BasisLayout::FileOrder));
+        for (size_t k = 0; k < 3 * 5 * 2 * 7; k++) fk.data()[k] = static_cast<float>(k);
+        Field4D<float> pixel_major = convert_layout(fk, BasisLayout::PixelMajor);
+        if (pixel_major.stride(0) != 1 || pixel_major.stride(1) != 3) error++;
+        for (size_t b = 0; b < 3; b++)
+            for (size_t t = 0; t < 5; t++)
+                for (size_t i = 0; i < 2; i++)
+                    for (size_t x = 0; x < 7; x++)
+                        if (pixel_major(b, t, i, x) != fk(b, t, i, x)) error++;
+        // В той же раскладке — без копирования
+        if (convert_layout(pixel_major, BasisLayout::PixelMajor).stride(3) != pixel_major.stride(3)) error++;
+        std::cout << "pipeline: err = " << error;
+        if (error == 0) {
+            std::cout << " [PASSED]\n";
+        }
+        else {
+            std::cout << " [FAILED]\n";
+            all_passed = false;
+        }
+    }
+
+    // Согласованность размеров пакета: сигнал или basis другой длины T отвергается
+    {
+        int error = 0;
+        std::vector<Field3D<double>> waves;
+        waves.emplace_back(std::array<size_t, 3>{ 5, 2, 3 });
+        waves.emplace_back(std::array<size_t, 3>{ 5, 2, 3 });
+        Field4D<double> fk(std::array<size_t, 4>{ 4, 5, 2, 3 });
+        if (!batch_shapes_match(waves, fk) || !batch_shapes_match(waves, Field4D<double>())) error++;
+        if (batch_shapes_match(waves, Field4D<double>(std::array<size_t, 4>{ 4, 6, 2, 3 }))) error++;
+        waves.emplace_back(std::array<size_t, 3>{ 6, 2, 3 });
+        if (batch_shapes_match(waves, fk)) error++;
+        std::cout << "batch shapes: err = " << error;
+        if (error == 0) {
+            std::cout << " [PASSED]\n";
+        }
+        else {
+            std::cout << " [FAILED]\n";
+            all_passed = false;
+        }
+    }
+
+    // Сборка частей: пропущенный внутри части пакет и неполные параметры части отвергаются
+    {
+        int error = 0;
+        fs::path dir = fs::temp_directory_path() / "tsunami_merge_test";
+        fs::remove_all(dir);
+        fs::create_directories(dir);
+        auto write_shard = [&dir](int index, int y0, int y1, const nlohmann::json& written, const nlohmann::json& skipped) {
+            nlohmann::json data = nlohmann::json::object();
+            int rows = 0;
+            for (const auto& batch : written) rows += batch[1].get<int>() - batch[0].get<int>();
+            for (int i = 0; i < rows; i++) data["[" + std::to_string(i) + ",0]"] = { {"aprox_error", 0.5 * i}, {"coefs", {1.0 * y0, 2.0}} };
+            nlohmann::json meta = {
+                {"bath", "bath"}, {"wave", "wave"}, {"basis", "basis_2"}, {"solver", "orto"}, {"precision", "float64"},
+                {"support_threshold", 0.0}, {"rows", rows}, {"columns", 1},
+                {"region", { {"x", {0, 1, 1}}, {"y", {y0, y1, 1}}, {"t", {0, nullptr, 1}} }},
+                {"batches", { {"written", written}, {"skipped", skipped} }},
+                {"shard", { {"index", index}, {"count", 2} }}
+            };
+            std::string stem = (dir / ("part.shard-" + std::to_string(index) + "-of-2")).string();
+            std::ofstream(stem + ".json") << data.dump(4);
+            std::ofstream(stem + ".meta.json") << meta.dump(4);
+            return stem + ".json";
+        };
+        using nlohmann::json;
+        std::vector<std::string> parts = { write_shard(0, 0, 3, json::array({ {0, 2}, {2, 3} }), json::array()),
+            write_shard(1, 3, 5, json::array({ {3, 5} }), json::array()) };
+        std::string merged = (dir / "merged.json").string();
+        if (!merge_statistics_shards(merged, parts)) error++;
+        std::ifstream merged_stream(merged);
+        json merged_data = json::parse(merged_stream, nullptr, false);
+        if (merged_data.is_discarded() || merged_data.size() != 5 || merged_data["[3,0]"]["coefs"][0] != 3.0) error++;
+        // Пакет [3, 4) пропущен: строка 4 сдвинулась бы на место строки 3
+        parts[1] = write_shard(1, 3, 5, json::array({ {4, 5} }), json::array({ {3, 4} }));
+        if (merge_statistics_shards(merged, parts)) error++;
+        // Параметры без номера части и без области
+        parts[1] = write_shard(1, 3, 5, json::array({ {3, 5} }), json::array());
+        std::string meta1 = (dir / "part.shard-1-of-2.meta.json").string();
+        std::ifstream meta_stream(meta1);
+        json meta = json::parse(meta_stream);
+        meta_stream.close();
+        json no_shard = meta;
+        no_shard.erase("shard");
+        std::ofstream(meta1) << no_shard.dump();
+        if (merge_statistics_shards(merged, parts)) error++;
+        json no_region = meta;
+        no_region.erase("region");
+        std::ofstream(meta1) << no_region.dump();
+        if (merge_statistics_shards(merged, parts)) error++;
+        fs::remove_all(dir);
+        std::cout << "merge shards: err = " << error;
+        if (error == 0) {
+            std::cout << " [PASSED]\n";
+        }
+        else {
+            std::cout << " [FAILED]\n";
+            all_passed = false;
+        }
+    }
+
+    // Отпечаток файла: меняется от байта в середине файла, запомненный хеш берётся только
+    // при тех же размере и времени изменения
+    {
+        int error = 0;
+        fs::path dir = fs::temp_directory_path() / "tsunami_fingerprint_test";
+        fs::remove_all(dir);
+        fs::create_directories(dir);
+        fs::path file = dir / "data.bin";
+        std::vector<char> bytes(3 << 20);
+        for (size_t k = 0; k < bytes.size(); k++) bytes[k] = static_cast<char>(k * 7919 % 251);
+        auto write = [&] {
+            std::ofstream ofs(file, std::ios::binary);
+            ofs.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+        };
+        write();
+        auto mtime = fs::last_write_time(file);
+        uint64_t original = fingerprint_file(file);
+        if (original == 0 || fingerprint_file(file) != original || !fs::exists(dir / "data.bin.fingerprint")) error++;
+        bytes[bytes.size() / 2 + 12345] ^= 1;
+        write();
+        fs::last_write_time(file, mtime + std::chrono::seconds(1));
+        if (fingerprint_file(file) == original) error++;
+        fs::remove(dir / "data.bin.fingerprint");
+        if (fingerprint_file(file) == original) error++;
+        fs::remove_all(dir);
+        std::cout << "fingerprint: err = " << error;
+        if (error == 0) {
+            std::cout << " [PASSED]\n";
+        }
+        else {
+            std::cout << " [FAILED]\n";
+            all_passed = false;
+        }
+    }
+
+    // Контрольные точки: пакет восстанавливается после повторного открытия с resume, но не при
+    // других входах, без resume или с повреждённым файлом
+    {
+        int error = 0;
+        fs::path dir = fs::temp_directory_path() / "tsunami_checkpoint_test";
+        fs::remove_all(dir);
+        CheckpointRows rows(3, std::vector<std::vector<CoefficientData>>(2, std::vector<CoefficientData>(4)));
+        for (size_t i = 0; i < rows.size(); i++)
+            for (size_t w = 0; w < rows[i].size(); w++)
+                for (size_t x = 0; x < rows[i][w].size(); x++) {
+                    rows[i][w][x].coefs = Eigen::VectorXd::LinSpaced(5, double(i), double(i + w + x));
+                    rows[i][w][x].aprox_error = 0.5 * i + w + 0.25 * x;
+                }
+        CheckpointStore store;
+        if (!store.open(dir.string(), "job", 42, false) || !store.save(10, 13, rows) || !store.save(13, 16, rows)) error++;
+        CheckpointRows restored;
+        CheckpointStore resumed;
+        if (!resumed.open(dir.string(), "job", 42, true) || !resumed.restore(10, 13, restored) || resumed.restore(16, 19, restored)) error++;
+        for (size_t i = 0; i < rows.size() && restored.size() == rows.size(); i++)
+            for (size_t w = 0; w < rows[i].size(); w++)
+                for (size_t x = 0; x < rows[i][w].size(); x++)
+                    if (restored[i][w][x].coefs != rows[i][w][x].coefs || restored[i][w][x].aprox_error != rows[i][w][x].aprox_error) error++;
+        if (restored.size() != rows.size()) error++;
+        // Обрезанный файл пакета
+        fs::resize_file(dir / "job.y13-16.ckpt", fs::file_size(dir / "job.y13-16.ckpt") - 8);
+        if (resumed.restore(13, 16, restored)) error++;
+        CheckpointStore changed;
+        if (!changed.open(dir.string(), "job", 43, true) || changed.restore(10, 13, restored)) error++;
+        CheckpointStore fresh;
+        if (!fresh.open(dir.string(), "job", 43, false) || fresh.restore(10, 13, restored)) error++;
+        fs::remove_all(dir);
+        std::cout << "checkpoint: err = " << error;
+        if (error == 0) {
+            std::cout << " [PASSED]\n";
+        }
+        else {
+            std::cout << " [FAILED]\n";
+            all_passed = false;
+        }
+    }
+
+    // Строки общей области мариограмм: представление удерживает область после освобождения ссылки
+    {
+        auto field = std::make_shared<Field3D<double>>(std::array<size_t, 3>{ 4, 10, 3 });
+        for (size_t t = 0; t < 4; t++)
+            for (size_t i = 0; i < 10; i++)
+                for (size_t x = 0; x < 3; x++) (*field)(t, i, x) = t + 10.0 * i + 100.0 * x;
+        std::shared_ptr<const Field3D<double>> resident = field;
+        field.reset();
+        Field3D<double> rows = wave_rows(resident, 6, 8);
+        resident.reset();
+        double error = (rows.empty() || rows.owns_data() || rows.size(1) != 4) ? 1 : 0;
+        for (size_t t = 0; t < 4 && error == 0; t++)
+            for (size_t i = 0; i < 4; i++)
+                for (size_t x = 0; x < 3; x++) error = std::max(error, std::abs(rows(t, i, x) - (t + 10.0 * (i + 6) + 100.0 * x)));
+        std::cout << "wave rows: err = " << error;
+        if (error < tol) {
+            std::cout << " [PASSED]\n";
+        }
+        else {
+            std::cout << " [FAILED]\n";
+            all_passed = false;
+        }
     }
 
     if (all_passed) {
@@ -181,7 +831,199 @@ int main() {
     return 0;
 }
 #else
-int main() {
+static void print_usage() {
+    std::cout << "usage: TsunamiCoefficientsCalculator [options]\n"
+              << "  --roi x0:x1[:sx],y0:y1[:sy]  region of interest in file coordinates (with optional strides)\n"
+              << "  --roi zone                   region of interest from mariogramm_zone in zones.json\n"
+              << "  --time t0:t1[:st]            time window [t0, t1) of the records with optional decimation step\n"
+              << "  --packed DIR                 read basis_N from DIR/basis_N.tsb (see convert) instead of NetCDF\n"
+              << "  --memory-budget SIZE         size y-batches to fit SIZE bytes (suffix K, M, G or T), e.g. 48G\n"
+              << "  --threads N                  solver threads (default: all hardware threads)\n"
+              << "  --tile WxR                   solver tile of W pixels by R rows (default: L2-sized)\n"
+              << "  --io-workers N               basis reader threads (default 1; concurrent reads need a NETCDF_THREADSAFE build)\n"
+              << "  --queue-depth N              batches queued between pipeline stages (default 1; 0 runs stages one after another)\n"
+              << "  --shard k/N                  compute only part k of N of the region rows (0-based), see merge\n"
+              << "  --checkpoint DIR             save every finished y-batch and a manifest to DIR\n"
+              << "  --resume                     skip batches already saved in the --checkpoint DIR by an interrupted run\n"
+              << "  --no-wave-cache              re-read the wave file for every basis folder instead of keeping it in memory\n"
+              << "usage: TsunamiCoefficientsCalculator convert BASIS_FOLDER OUT.tsb [--wave WAVE.nc] [--float32]\n"
+              << "  packs a basis folder (and a wave file) into one memory-mapped pixel-major file\n"
+              << "usage: TsunamiCoefficientsCalculator merge OUT.json PART.json...\n"
+              << "  assembles the partial outputs of --shard runs into one coefficients file and checks coverage\n"
+              << "usage: TsunamiCoefficientsCalculator bench-tiles [--basis N] [--samples T] [--size HxW]\n"
+              << "           [--tiles WxR,WxR,...] [--threads N] [--lanes L] [--pixel-major]\n"
+              << "  solver throughput (pixels/s) for each tile shape on a synthetic batch\n";
+}
+
+// Подкоманда convert: упаковка basis-папки (и мариограмм) в один файл
+static int run_convert(int argc, char** argv) {
+    if (argc < 4) {
+        print_usage();
+        return 1;
+    }
+    std::string wave_file;
+    size_t element_size = sizeof(double);
+    for (int k = 4; k < argc; k++) {
+        std::string arg = argv[k];
+        if (arg == "--wave" && k + 1 < argc) {
+            wave_file = argv[++k];
+        } else if (arg == "--float32") {
+            element_size = sizeof(float);
+        } else {
+            std::cerr << "Неизвестный аргумент: " << arg << std::endl;
+            print_usage();
+            return 1;
+        }
+    }
+    return convert_basis_folder(argv[2], wave_file, argv[3], element_size) ? 0 : 1;
+}
+
+// Подкоманда bench-tiles: скорость решения для разных форм плитки
+static int run_tile_benchmark(int argc, char** argv) {
+    int n_basis = 24, T = 1000, height = 64, width = 64;
+    std::vector<std::pair<int, int>> shapes = { { 1, 1 }, { 8, 1 }, { 8, 4 }, { 16, 4 }, { 8, 16 }, { 64, 1 } };
+    StatisticsOptions options;
+    for (int k = 2; k < argc; k++) {
+        std::string arg = argv[k];
+        bool ok = true;
+        if (arg == "--basis" && k + 1 < argc) {
+            n_basis = std::atoi(argv[++k]);
+            ok = n_basis > 0;
+        } else if (arg == "--samples" && k + 1 < argc) {
+            T = std::atoi(argv[++k]);
+            ok = T > 0;
+        } else if (arg == "--size" && k + 1 < argc) {
+            ok = parse_tile(argv[++k], height, width);
+        } else if (arg == "--tiles" && k + 1 < argc) {
+            shapes.clear();
+            std::string list = argv[++k];
+            for (size_t pos = 0; ok && pos <= list.size();) {
+                size_t comma = list.find(',', pos);
+                std::pair<int, int> shape;
+                ok = parse_tile(list.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos), shape.first, shape.second);
+                shapes.push_back(shape);
+                pos = comma == std::string::npos ? list.size() + 1 : comma + 1;
+            }
+        } else if (arg == "--threads" && k + 1 < argc) {
+            int threads = std::atoi(argv[++k]);
+            ok = threads > 0;
+            if (ok) options.thread_pool = std::make_shared<ThreadPool>(threads);
+        } else if (arg == "--lanes" && k + 1 < argc) {
+            options.batch_lanes = std::atoi(argv[++k]);
+        } else if (arg == "--pixel-major") {
+            options.basis_layout = BasisLayout::PixelMajor;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            std::cerr << "Неверный аргумент: " << arg << std::endl;
+            print_usage();
+            return 1;
+        }
+    }
+    benchmark_tile_shapes(n_basis, T, height, width, shapes, options);
+    return 0;
+}
+
+// Разбор аргументов командной строки; false — ошибка (сообщение уже выведено)
+static bool parse_arguments(int argc, char** argv, const AreaConfigurationInfo& area_config, StatisticsOptions& options) {
+    for (int k = 1; k < argc; k++) {
+        std::string arg = argv[k];
+        if (arg == "--roi" && k + 1 < argc) {
+            std::string value = argv[++k];
+            if (value == "zone") {
+                options.region = area_config.mariogramm_region().with_time_of(options.region);
+                if (options.region.empty()) {
+                    std::cerr << "mariogramm_zone не задана в zones.json" << std::endl;
+                    return false;
+                }
+            } else if (!parse_region(value, options.region)) {
+                std::cerr << "Неверная область: " << value << std::endl;
+                return false;
+            }
+        } else if (arg == "--time" && k + 1 < argc) {
+            std::string value = argv[++k];
+            if (!parse_range(value, options.region.t0, options.region.t1, options.region.t_stride)) {
+                std::cerr << "Неверное временное окно: " << value << std::endl;
+                return false;
+            }
+        } else if (arg == "--memory-budget" && k + 1 < argc) {
+            std::string value = argv[++k];
+            if (!parse_size(value, options.memory_budget)) {
+                std::cerr << "Неверный бюджет памяти: " << value << std::endl;
+                return false;
+            }
+        } else if (arg == "--threads" && k + 1 < argc) {
+            int threads = std::atoi(argv[++k]);
+            if (threads < 1) {
+                std::cerr << "Неверное число потоков: " << argv[k] << std::endl;
+                return false;
+            }
+            options.thread_pool = std::make_shared<ThreadPool>(threads);
+        } else if (arg == "--tile" && k + 1 < argc) {
+            std::string value = argv[++k];
+            if (!parse_tile(value, options.tile_width, options.tile_rows)) {
+                std::cerr << "Неверная форма плитки: " << value << std::endl;
+                return false;
+            }
+        } else if (arg == "--io-workers" && k + 1 < argc) {
+            int workers = std::atoi(argv[++k]);
+            if (workers < 1) {
+                std::cerr << "Неверное число потоков чтения: " << argv[k] << std::endl;
+                return false;
+            }
+            options.io_workers = workers;
+        } else if (arg == "--queue-depth" && k + 1 < argc) {
+            std::string value = argv[++k];
+            if (value.empty() || value.size() > 3 || value.find_first_not_of("0123456789") != std::string::npos) {
+                std::cerr << "Неверная глубина очереди: " << value << std::endl;
+                return false;
+            }
+            options.queue_depth = std::atoi(value.c_str());
+        } else if (arg == "--shard" && k + 1 < argc) {
+            std::string value = argv[++k];
+            if (!parse_shard(value, options.shard_index, options.shard_count)) {
+                std::cerr << "Неверная часть: " << value << " (нужно k/N, 0 <= k < N)" << std::endl;
+                return false;
+            }
+        } else if (arg == "--no-wave-cache") {
+            options.wave_cache.reset();
+        } else if (arg == "--packed" && k + 1 < argc) {
+            options.packed_basis_dir = argv[++k];
+        } else if (arg == "--checkpoint" && k + 1 < argc) {
+            options.checkpoint_dir = argv[++k];
+        } else if (arg == "--resume") {
+            options.resume = true;
+        } else if (arg == "--help" || arg == "-h") {
+            print_usage();
+            return false;
+        } else {
+            std::cerr << "Неизвестный аргумент: " << arg << std::endl;
+            print_usage();
+            return false;
+        }
+    }
+    if (options.resume && options.checkpoint_dir.empty()) {
+        std::cerr << "--resume требует папку контрольных точек (--checkpoint DIR)" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && std::string(argv[1]) == "convert") {
+        return run_convert(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "merge") {
+        if (argc < 4) {
+            print_usage();
+            return 1;
+        }
+        return merge_statistics_shards(argv[2], std::vector<std::string>(argv + 3, argv + argc)) ? 0 : 1;
+    }
+    if (argc > 1 && std::string(argv[1]) == "bench-tiles") {
+        return run_tile_benchmark(argc, argv);
+    }
 
     // Запускаем тесты, если необходимо
     run_tests();
@@ -211,11 +1053,35 @@ int main() {
 
     // Инициализация конфигурации области (файл zones.json должен быть корректным)
     AreaConfigurationInfo area_config("T:/tsunami_res_folder/info/zones.json");
+    StatisticsOptions options;
+    // Несколько basis-папок с одним wave: мариограммы читаются один раз на всё задание
+    if (folderNames.size() > 1) {
+        options.wave_cache = std::make_shared<WaveFieldCache>();
+    }
+    if (!parse_arguments(argc, argv, area_config, options)) {
+        return 1;
+    }
+    // Один пул потоков на всё задание
+    if (!options.thread_pool) {
+        options.thread_pool = std::make_shared<ThreadPool>();
+    }
+
+    // Файл мариограмм копируется в кэш один раз на задание (runWithPrePost не трогает уже скопированный)
+    std::string sourceWaveFile = root_folder + "/" + bath + "/" + wave + ".nc";
+    std::string destWaveFile = cache_folder + "/" + bath + "/" + wave + ".nc";
+    bool copiedWave = false;
+    if (folderNames.size() > 1 && !fileExists(destWaveFile) && fs::exists(sourceWaveFile)) {
+        copiedWave = copyFile(sourceWaveFile, destWaveFile);
+    }
 
     // Вычисляем и сохраняем статистику аппроксимации
     for (auto& basis : folderNames)
     {
-        runWithPrePost(root_folder, cache_folder, bath, wave, basis, area_config);
+        runWithPrePost(root_folder, cache_folder, bath, wave, basis, area_config, options);
+    }
+
+    if (copiedWave && !deleteFile(destWaveFile)) {
+        std::cerr << "Не удалось удалить файл: " << destWaveFile << std::endl;
     }
     return 0;
 }
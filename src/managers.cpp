@@ -1,4 +1,6 @@
 #include "managers.h"
+#include "packed_basis.h"
+#include "fingerprint.h"
 #include <netcdf.h>
 #include <iostream>
 #include <filesystem>
@@ -8,106 +10,211 @@
 #include <regex>
 namespace fs = std::filesystem;
 
-//    NetCDF-   
-int open_nc_file(const std::string& filename, int& ncid) {
-    int retval = nc_open(filename.c_str(), NC_NOWRITE, &ncid);
-    if (retval != NC_NOERR) {
-        std::cerr << "   " << filename << " : " << nc_strerror(retval) << std::endl;
-    }
-    return retval;
+// Чтение гиперсреза с шагами в нужном типе; NetCDF сам преобразует тип переменной в тип буфера
+int nc_get_vars(int ncid, int varid, const size_t* start, const size_t* count, const ptrdiff_t* stride, double* buffer) {
+    return nc_get_vars_double(ncid, varid, start, count, stride, buffer);
+}
+int nc_get_vars(int ncid, int varid, const size_t* start, const size_t* count, const ptrdiff_t* stride, float* buffer) {
+    return nc_get_vars_float(ncid, varid, start, count, stride, buffer);
 }
-std::vector<std::vector<std::vector<double>>> read_nc_file(const fs::path& file, int y_start, int y_end) {
-    std::vector<std::vector<std::vector<double>>> data;
-    std::cout << "loading: " << file << std::endl;
-    int ncid;
 
-    if (open_nc_file(file.string(), ncid) != NC_NOERR)
-        return data;
+std::array<size_t, 4> basis_strides(const std::array<size_t, 4>& shape, BasisLayout layout) {
+    if (layout == BasisLayout::FileOrder) {
+        return Field4D<double>::row_major_strides(shape);
+    }
+    // (b, t, i, x) -> ((i * X + x) * T + t) * n + b
+    const size_t n = shape[0], T = shape[1], X = shape[3];
+    return { 1, n, X * T * n, T * n };
+}
 
-    int varid;
-    int retval = nc_inq_varid(ncid, "height", &varid);
-    if (retval != NC_NOERR) {
-        std::cerr << " 'height'    " << file.string() << std::endl;
-        nc_close(ncid);
-        return data;
+template <typename Scalar>
+Field4D<Scalar> convert_layout(Field4D<Scalar> fk, BasisLayout layout) {
+    std::array<size_t, 4> strides = basis_strides(fk.shape(), layout);
+    if (fk.empty() || (fk.stride(0) == strides[0] && fk.stride(1) == strides[1] && fk.stride(2) == strides[2] && fk.stride(3) == strides[3])) {
+        return fk;
+    }
+    Field4D<Scalar> result(fk.shape(), strides);
+    const size_t n = fk.size(0), T = fk.size(1), height = fk.size(2), X = fk.size(3);
+    // Источник читается подряд по x (последний индекс раскладки FileOrder)
+    for (size_t i = 0; i < height; i++) {
+        for (size_t b = 0; b < n; b++) {
+            for (size_t t = 0; t < T; t++) {
+                const Scalar* src = &fk(b, t, i, 0);
+                Scalar* dst = &result(b, t, i, 0);
+                for (size_t x = 0; x < X; x++) {
+                    dst[x * strides[3]] = src[x * fk.stride(3)];
+                }
+            }
+        }
     }
+    return result;
+}
+
+template Field4D<double> convert_layout<double>(Field4D<double>, BasisLayout);
+template Field4D<float> convert_layout<float>(Field4D<float>, BasisLayout);
 
-    int ndims;
-    nc_inq_varndims(ncid, varid, &ndims);
-    if (ndims != 3) {
-        std::cerr << " 3    " << file.string() << std::endl;
-        nc_close(ncid);
-        return data;
+// Область region, обрезанная по размерам переменной "height" файла (и по длине записи)
+static bool clip_region(NcHandlePool& pool, const fs::path& file, const RegionOfInterest& region, RegionOfInterest& clipped) {
+    NcVariable variable;
+    if (pool.acquire(file.string(), variable) != NC_NOERR)
+        return false;
+    if (!clip_to_shape(region, variable.T, variable.Y, variable.X, clipped)) {
+        std::cerr << "Регион x [" << region.x0 << ", " << region.x1 << "), y [" << region.y0 << ", " << region.y1
+                  << "), t [" << region.t0 << ", " << region.t1 << ") вне файла " << file.string() << std::endl;
+        return false;
     }
+    return true;
+}
 
-    int dimids[3];
-    size_t T, Y, X;
-    nc_inq_vardimid(ncid, varid, dimids);
-    nc_inq_dimlen(ncid, dimids[0], &T);
-    nc_inq_dimlen(ncid, dimids[1], &Y);
-    nc_inq_dimlen(ncid, dimids[2], &X);
+// Чтение гиперсреза region переменной "height" в out (t, i, x); файл берётся из пула открытых
+// файлов. Если out хранится построчно, NetCDF пишет прямо в него, иначе — через buffer
+// с раскладкой по шагам out
+template <typename Scalar>
+static bool read_nc_file(NcHandlePool& pool, const fs::path& file, const RegionOfInterest& region, TensorView<Scalar, 3> out, std::vector<Scalar>& buffer) {
+    std::cout << "loading: " << file << std::endl;
 
-    int local_y_end = y_end;
-    if (static_cast<size_t>(local_y_end) > Y)
-        local_y_end = static_cast<int>(Y);
-    size_t region_height = local_y_end - y_start;
-    data.resize(T, std::vector<std::vector<double>>(region_height, std::vector<double>(X, 0.0)));
+    NcVariable variable;
+    if (pool.acquire(file.string(), variable) != NC_NOERR)
+        return false;
+    const size_t T = out.size(0), region_height = out.size(1), X = out.size(2);
+    size_t last_t = region.t0 + (T - 1) * region.t_stride;
+    size_t last_y = region.y0 + (region_height - 1) * region.y_stride;
+    size_t last_x = region.x0 + (X - 1) * region.x_stride;
+    if (last_t >= variable.T || last_y >= variable.Y || last_x >= variable.X) {
+        std::cerr << "Размеры переменной 'height' в " << file.string() << " не совпадают с остальными файлами" << std::endl;
+        return false;
+    }
+
+    bool contiguous = out.stride(2) == 1 && out.stride(1) == X && out.stride(0) == region_height * X;
+    Scalar* target = out.data;
+    if (!contiguous) {
+        buffer.resize(T * region_height * X);
+        target = buffer.data();
+    }
 
-    size_t start[3] = { 0, static_cast<size_t>(y_start), 0 };
+    size_t start[3] = { static_cast<size_t>(region.t0), static_cast<size_t>(region.y0), static_cast<size_t>(region.x0) };
     size_t count[3] = { T, region_height, X };
-    std::vector<double> buffer(T * region_height * X, 0.0);
+    ptrdiff_t stride[3] = { region.t_stride, region.y_stride, region.x_stride };
     std::cout << "start\n";
-    retval = nc_get_vara_double(ncid, varid, start, count, buffer.data());
+    int retval;
+    {
+        NcLock nc_lock;
+        retval = nc_get_vars(variable.ncid, variable.varid, start, count, stride, target);
+    }
     std::cout << "end\n";
     if (retval != NC_NOERR) {
-        std::cerr << "   " << file.string() << " : " << nc_strerror(retval) << std::endl;
-        nc_close(ncid);
-        return data;
-    }
-    nc_close(ncid);
-
-    //      3D-
-    for (size_t t = 0; t < T; t++) {
-        for (size_t i = 0; i < region_height; i++) {
-            for (size_t x = 0; x < X; x++) {
-                size_t idx = t * region_height * X + i * X + x;
-                data[t][i][x] = buffer[idx];
+        std::cerr << "Ошибка чтения файла " << file.string() << " : " << nc_strerror(retval) << std::endl;
+        pool.close(file.string());
+        return false;
+    }
+
+    // Раскладка прочитанного буфера по шагам out
+    if (!contiguous) {
+        for (size_t t = 0; t < T; t++) {
+            for (size_t i = 0; i < region_height; i++) {
+                for (size_t x = 0; x < X; x++) {
+                    out(t, i, x) = buffer[(t * region_height + i) * X + x];
+                }
             }
         }
     }
+    return true;
+}
+
+// Реализация метода WaveManager::load_mariogramm_by_region с использованием netcdf.h
+template <typename Scalar>
+Field3D<Scalar> WaveManager::load_mariogramm_by_region(const RegionOfInterest& region) {
+    if (packed) {
+        return packed->wave_region<Scalar>(region);
+    }
+    RegionOfInterest clipped;
+    if (!clip_region(*pool, nc_file, region, clipped))
+        return Field3D<Scalar>();
+    Field3D<Scalar> data({ static_cast<size_t>(clipped.duration()), static_cast<size_t>(clipped.height()), static_cast<size_t>(clipped.width()) });
+    std::vector<Scalar> buffer;
+    if (!read_nc_file<Scalar>(*pool, nc_file, clipped, data.view(), buffer))
+        return Field3D<Scalar>();
     return data;
 }
 
-//   WaveManager::load_mariogramm_by_region   netcdf.h
-std::vector<std::vector<std::vector<double>>> WaveManager::load_mariogramm_by_region(int y_start, int y_end) {
-    
-    return read_nc_file(nc_file,y_start,y_end);
+// Разбор хранения файла и план пакетов по нему; при ошибке — план без учёта блоков
+static BatchPlan plan_for_file(NcHandlePool& pool, const fs::path& file, const RegionOfInterest& roi, int batch_rows, NcStorage& storage) {
+    storage = NcStorage();
+    NcVariable variable;
+    if (pool.acquire(file.string(), variable) == NC_NOERR && inspect_storage(variable, storage) != NC_NOERR) {
+        std::cerr << "Не удалось разобрать хранение переменной 'height' в " << file.string() << std::endl;
+        storage = NcStorage();
+    }
+    BatchPlan plan = plan_batches(storage, roi, batch_rows);
+    // Целиком прочитанные блоки вытесняются из кэша первыми: в нём остаются только блоки,
+    // общие с соседним пакетом
+    pool.set_chunk_cache(plan.chunk_cache_bytes, plan.chunk_cache_slots, 1.0f);
+    return plan;
+}
+
+bool WaveManager::use_packed(const std::shared_ptr<PackedBasis>& packed_file) {
+    if (!packed_file || !packed_file->has_wave() || packed_file->wave_name() != fs::path(nc_file).filename().string())
+        return false;
+    if (fs::exists(nc_file) && fingerprint_file(nc_file) != packed_file->header().wave_hash) {
+        std::cerr << "Мариограммы в упакованном файле устарели: " << nc_file << std::endl;
+        return false;
+    }
+    packed = packed_file;
+    return true;
+}
+
+bool WaveManager::inspect(NcStorage& storage) {
+    storage = NcStorage();
+    if (packed) {
+        storage.shape[0] = packed->header().T;
+        storage.shape[1] = packed->header().Y;
+        storage.shape[2] = packed->header().X;
+        storage.element_size = packed->header().element_size;
+        return true;
+    }
+    NcVariable variable;
+    if (pool->acquire(nc_file, variable) != NC_NOERR)
+        return false;
+    return inspect_storage(variable, storage) == NC_NOERR;
 }
 
+void WaveManager::plan_chunk_cache(const RegionOfInterest& roi, int batch_rows) {
+    if (packed) return;
+    NcStorage storage;
+    plan_for_file(*pool, nc_file, roi, batch_rows, storage);
+}
 
-//       
+void WaveManager::close() {
+    pool->close_all();
+}
+
+template Field3D<double> WaveManager::load_mariogramm_by_region<double>(const RegionOfInterest&);
+template Field3D<float> WaveManager::load_mariogramm_by_region<float>(const RegionOfInterest&);
+
+
+// Функция для извлечения индекса из имени файла
 int extractIndex(const fs::path& filePath) {
-    //      _<>.nc
+    // Регулярное выражение для поиска шаблона _<число>.nc
     std::regex regexPattern("_(\\d+)\\.nc");
     std::smatch match;
     std::string filename = filePath.filename().string();
     if (std::regex_search(filename, match, regexPattern)) {
         return std::stoi(match[1].str());
     }
-    //    ,   ,
-    //       .
+    // Если индекс не найден, возвращаем максимальное значение,
+    // чтобы файл оказался в конце отсортированного списка.
     return std::numeric_limits<int>::max();
 }
 
-//      
+// Функция для получения отсортированного списка файлов
 std::vector<fs::path> getSortedFileList(const std::string& folder) {
     std::vector<fs::path> files;
 
-    //      
+    // Перебираем все файлы в заданной директории
     for (const auto& entry : fs::directory_iterator(folder)) {
         if (entry.is_regular_file()) {
             fs::path filePath = entry.path();
-            // ,     ".nc"    '_'
+            // Проверяем, что файл имеет расширение ".nc" и содержит символ '_'
             if (filePath.extension() == ".nc" &&
                 filePath.filename().string().find('_') != std::string::npos) {
                 files.push_back(filePath);
@@ -115,7 +222,7 @@ std::vector<fs::path> getSortedFileList(const std::string& folder) {
         }
     }
 
-    //     ,    
+    // Сортируем файлы по числовому значению, извлечённому из имени файла
     std::sort(files.begin(), files.end(), [](const fs::path& a, const fs::path& b) {
         return extractIndex(a) < extractIndex(b);
         });
@@ -124,16 +231,134 @@ std::vector<fs::path> getSortedFileList(const std::string& folder) {
 }
 
 
-std::vector<std::vector<std::vector<std::vector<double>>>> BasisManager::get_fk_region(int y_start, int y_end) {
-    std::vector<std::vector<std::vector<std::vector<double>>>> fk;
-    std::vector<fs::path> files = getSortedFileList(folder);
+std::vector<fs::path> BasisManager::files() const {
+    if (packed) {
+        std::vector<fs::path> names;
+        for (const auto& name : packed->basis_names()) {
+            names.push_back(fs::path(folder) / name);
+        }
+        return names;
+    }
+    return getSortedFileList(folder);
+}
+
+uint64_t BasisManager::fingerprint() const {
+    return packed ? packed->header().basis_hash : fingerprint_files(files());
+}
 
-    //   
-    for (const auto& file : files) {
-        auto file_data = read_nc_file(file, y_start, y_end);
-        if (!file_data.empty()) {
-            fk.push_back(file_data);
+bool BasisManager::open_packed(const std::string& path) {
+    auto packed_file = std::make_shared<PackedBasis>();
+    if (!packed_file->open(path))
+        return false;
+    std::error_code ec;
+    if (fs::is_directory(folder, ec)) {
+        std::vector<fs::path> source = getSortedFileList(folder);
+        if (!source.empty() && fingerprint_files(source) != packed_file->header().basis_hash) {
+            std::cerr << "Упакованный basis устарел: " << path << std::endl;
+            return false;
         }
     }
+    packed = packed_file;
+    std::cout << "packed basis: " << path << "\n";
+    return true;
+}
+
+BasisManager::BasisManager(const std::string& folder_, int io_workers, size_t max_open) : folder(folder_) {
+    int workers = std::max(1, io_workers);
+    // Ограничение на открытые файлы делится между потоками чтения
+    size_t max_open_per_worker = std::max<size_t>(1, max_open / workers);
+    for (int w = 0; w < workers; w++) {
+        pools.push_back(std::make_unique<NcHandlePool>(max_open_per_worker));
+    }
+}
+
+size_t BasisManager::total_opens() const {
+    size_t total = 0;
+    for (const auto& pool : pools) {
+        total += pool->total_opens();
+    }
+    return total;
+}
+
+template <typename Scalar>
+Field4D<Scalar> BasisManager::get_fk_region(const RegionOfInterest& region) {
+    if (packed) {
+        return packed->basis_region<Scalar>(region);
+    }
+    std::vector<fs::path> files = getSortedFileList(folder);
+    if (files.empty()) return Field4D<Scalar>();
+
+    // Размеры по первому файлу (он читается потоком 0), память под все файлы — одним выделением
+    RegionOfInterest clipped;
+    if (!clip_region(*pools[0], files[0], region, clipped))
+        return Field4D<Scalar>();
+    std::array<size_t, 4> shape = { files.size(), static_cast<size_t>(clipped.duration()),
+        static_cast<size_t>(clipped.height()), static_cast<size_t>(clipped.width()) };
+    Field4D<Scalar> fk(shape, basis_strides(shape, layout));
+
+    // Поток w читает файлы w, w + workers, ... через свой пул, поэтому файл всегда открыт
+    // в одном и том же потоке и дескрипторы потоков не пересекаются. Каждый файл пишется
+    // в свой срез fk
+    int workers = std::min<int>(io_workers(), static_cast<int>(files.size()));
+    std::vector<char> loaded(files.size(), 0);
+    std::vector<std::future<void>> futures;
+    for (int w = 0; w < workers; w++) {
+        futures.push_back(std::async(std::launch::async, [this, w, workers, &clipped, &files, &fk, &loaded]() {
+            std::vector<Scalar> buffer;
+            for (size_t k = w; k < files.size(); k += workers) {
+                loaded[k] = read_nc_file<Scalar>(*pools[w], files[k], clipped, fk.slice(k), buffer);
+            }
+            }));
+    }
+    for (auto& future : futures) {
+        future.get();
+    }
+
+    // Без одного из файлов номера базисных функций сдвинулись бы, поэтому пакет не используется
+    if (std::find(loaded.begin(), loaded.end(), 0) != loaded.end()) {
+        std::cerr << "Не все basis-файлы прочитаны для y [" << region.y0 << ", " << region.y1 << ")" << std::endl;
+        return Field4D<Scalar>();
+    }
     return fk;
-}
\ No newline at end of file
+}
+
+bool BasisManager::inspect(NcStorage& storage) {
+    storage = NcStorage();
+    if (packed) {
+        storage.shape[0] = packed->header().T;
+        storage.shape[1] = packed->header().Y;
+        storage.shape[2] = packed->header().X;
+        storage.element_size = packed->header().element_size;
+        return true;
+    }
+    std::vector<fs::path> files = getSortedFileList(folder);
+    NcVariable variable;
+    if (files.empty() || pools[0]->acquire(files[0].string(), variable) != NC_NOERR)
+        return false;
+    return inspect_storage(variable, storage) == NC_NOERR;
+}
+
+BatchPlan BasisManager::plan_batches(const RegionOfInterest& roi, int batch_rows, NcStorage* storage_out) {
+    std::vector<fs::path> files = getSortedFileList(folder);
+    NcStorage storage;
+    if (packed || files.empty()) {
+        inspect(storage);
+        if (storage_out) *storage_out = storage;
+        return ::plan_batches(storage, roi, batch_rows);
+    }
+    BatchPlan plan = plan_for_file(*pools[0], files[0], roi, batch_rows, storage);
+    for (size_t w = 1; w < pools.size(); w++) {
+        pools[w]->set_chunk_cache(plan.chunk_cache_bytes, plan.chunk_cache_slots, 1.0f);
+    }
+    if (storage_out) *storage_out = storage;
+    return plan;
+}
+
+void BasisManager::close() {
+    for (auto& pool : pools) {
+        pool->close_all();
+    }
+}
+
+template Field4D<double> BasisManager::get_fk_region<double>(const RegionOfInterest&);
+template Field4D<float> BasisManager::get_fk_region<float>(const RegionOfInterest&);
\ No newline at end of file
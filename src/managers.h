@@ -3,30 +3,150 @@
 
 #include <string>
 #include <vector>
+#include <filesystem>
+#include <memory>
+#include <array>
+#include <iostream>
 #include "stable_data_structs.h"
+#include "nc_pool.h"
+#include "tensor.h"
+#include "batch_planner.h"
 
-//      basis,   NetCDF-
+class PackedBasis;
+
+// Поле "height" из NetCDF в области расчёта: (t, i, x) = [T][region_height][region_width], построчно, как в файле.
+// Scalar — тип хранения (double или float)
+template <typename Scalar>
+using Field3D = Tensor<Scalar, 3>;
+// Набор полей basis: логически (b, t, i, x) = [num_files][T][region_height][region_width], порядок хранения — BasisLayout
+template <typename Scalar>
+using Field4D = Tensor<Scalar, 4>;
+
+// Порядок хранения Field4D
+enum class BasisLayout {
+    FileOrder,  // [b][t][i][x] — как в файлах: каждый файл читается прямо в свой срез
+    PixelMajor  // [i][x][t][b] — блок n_basis x T каждого пикселя непрерывен (по столбцам, как Eigen::MatrixXd)
+};
+
+// Шаги Field4D формы (b, t, i, x) для раскладки layout
+std::array<size_t, 4> basis_strides(const std::array<size_t, 4>& shape, BasisLayout layout);
+
+// fk в раскладке layout (новый тензор с теми же логическими индексами); если fk уже в ней —
+// он сам без копирования
+template <typename Scalar>
+Field4D<Scalar> convert_layout(Field4D<Scalar> fk, BasisLayout layout);
+
+// Число потоков чтения basis-файлов по умолчанию (StatisticsOptions::io_workers, --io-workers).
+// Каждый поток работает со своими дескрипторами, но вызовы NetCDF идут под общей блокировкой NcLock:
+// несколько потоков читают одновременно только в сборке NETCDF_THREADSAFE
+constexpr int default_io_workers = 1;
+
+// Класс для работы с данными basis, содержащимися в NetCDF-файлах
 class BasisManager {
 public:
-    std::string folder; //     basis- (NetCDF-)
+    std::string folder; // путь к каталогу с basis-файлами (NetCDF-файлы)
+    // Открытые basis-файлы: по пулу на каждый поток чтения (свои ncid), файл k читает поток k % io_workers.
+    // Файлы остаются открытыми между пакетами до close(); всего открыто не более max_open
+    std::vector<std::unique_ptr<NcHandlePool>> pools;
+    BasisLayout layout = BasisLayout::FileOrder; // порядок хранения результата get_fk_region
+    // Упакованный basis (packed_basis.h): если открыт, регионы берутся из него, а не из NetCDF
+    std::shared_ptr<PackedBasis> packed;
+
+    explicit BasisManager(const std::string& folder_,
+        int io_workers = default_io_workers,
+        size_t max_open = default_max_open_nc_files);
+
+    int io_workers() const { return static_cast<int>(pools.size()); }
+    // Сколько раз basis-файлы открывались за время жизни менеджера
+    size_t total_opens() const;
+
+    // Список basis-файлов в порядке их индексов (порядок базисных функций);
+    // для упакованного basis — имена из его заголовка в папке folder
+    std::vector<std::filesystem::path> files() const;
 
-    explicit BasisManager(const std::string& folder_) : folder(folder_) {}
+    // Отпечаток basis-файлов (fingerprint_files); для упакованного basis — записанный при упаковке
+    uint64_t fingerprint() const;
 
-    //    basis   [y_start, y_end)
-    //  4D : [num_files][T][region_height][X]
-    std::vector<std::vector<std::vector<std::vector<double>>>> get_fk_region(int y_start, int y_end);
+    // Открыть упакованный basis path. Если папка folder с basis-файлами доступна, её отпечаток
+    // сверяется с заголовком: устаревший файл не используется
+    bool open_packed(const std::string& path);
+
+    // Функция чтения данных basis для области region (обрезается по размерам файлов): файлы
+    // читаются параллельно io_workers потоками, порядок — как в getSortedFileList.
+    // Из упакованного basis — представление отображённого файла без копирования (только для
+    // чтения, раскладка всегда PixelMajor).
+    // Возвращает 4D массив (b, t, i, x) = [num_files][T][region.height()][region.width()] в типе Scalar
+    // (double или float) в раскладке layout; пустой — если хотя бы один файл не прочитан или размеры
+    // файлов различаются
+    template <typename Scalar = double>
+    Field4D<Scalar> get_fk_region(const RegionOfInterest& region);
+
+    // Хранение переменной "height" первого basis-файла (все файлы считаются устроенными одинаково)
+    bool inspect(NcStorage& storage);
+
+    // План y-пакетов по области roi (batch_rows строк области в пакете) с учётом блоков и сжатия
+    // basis-файлов (все файлы считаются устроенными одинаково, разбирается первый). Кэш блоков
+    // всех пулов настраивается под план; если хранение не разобрать — пакеты без выравнивания
+    BatchPlan plan_batches(const RegionOfInterest& roi, int batch_rows, NcStorage* storage_out = nullptr);
+
+    // Закрыть все открытые basis-файлы (при следующем чтении они откроются заново)
+    void close();
 };
 
-//      (Wave data)
+// Класс для работы с мариограммами (Wave data)
 class WaveManager {
 public:
-    std::string nc_file; //   NetCDF-  
+    std::string nc_file; // путь к NetCDF-файлу с мариограммами
+    // Файл остаётся открытым между пакетами до close()
+    std::unique_ptr<NcHandlePool> pool;
+    // Упакованный файл, в который записан этот wave: если задан, регионы берутся из него
+    std::shared_ptr<PackedBasis> packed;
+
+    explicit WaveManager(const std::string& nc_file_) : nc_file(nc_file_), pool(std::make_unique<NcHandlePool>(1)) {}
 
-    explicit WaveManager(const std::string& nc_file_) : nc_file(nc_file_) {}
+    // Функция загрузки данных переменной "height" для области region (обрезается по размерам файла)
+    // (из упакованного файла — представление без копирования)
+    // Возвращает 3D массив (t, i, x) = [T][region.height()][region.width()] в типе Scalar (double или float)
+    template <typename Scalar = double>
+    Field3D<Scalar> load_mariogramm_by_region(const RegionOfInterest& region);
 
-    //     "height"   [y_start, y_end)
-    //  3D : [T][region_height][X]
-    std::vector<std::vector<std::vector<double>>> load_mariogramm_by_region(int y_start, int y_end);
+    // Использовать мариограммы из упакованного файла, если он содержит этот wave (сверяется отпечаток)
+    bool use_packed(const std::shared_ptr<PackedBasis>& packed_file);
+
+    // Хранение переменной "height" файла мариограмм (для упакованного — размеры из его заголовка)
+    bool inspect(NcStorage& storage);
+
+    // Настройка кэша блоков файла мариограмм под пакеты по batch_rows строк области roi
+    void plan_chunk_cache(const RegionOfInterest& roi, int batch_rows);
+
+    // Закрыть файл мариограмм
+    void close();
 };
 
+// Размеры данных пакета согласованы: все сигналы waves той же формы (T, высота, ширина), что первый,
+// basis fk_data (пустой — не проверяется) — n_basis полей той же формы. Каждый файл обрезается по
+// своим размерам, поэтому без проверки решатель вышел бы за границы более короткого.
+// false — описание расхождения выводится в std::cerr
+template <typename Scalar>
+bool batch_shapes_match(const std::vector<Field3D<Scalar>>& waves, const Field4D<Scalar>& fk_data) {
+    if (waves.empty()) return true;
+    auto shape_text = [](size_t t, size_t i, size_t x) {
+        return std::to_string(t) + " x " + std::to_string(i) + " x " + std::to_string(x);
+    };
+    const Field3D<Scalar>& first = waves[0];
+    for (size_t w = 1; w < waves.size(); w++) {
+        if (waves[w].shape() != first.shape()) {
+            std::cerr << "Размеры мариограмм " << w << " (" << shape_text(waves[w].size(0), waves[w].size(1), waves[w].size(2))
+                      << ") и 0 (" << shape_text(first.size(0), first.size(1), first.size(2)) << ") различаются" << std::endl;
+            return false;
+        }
+    }
+    if (!fk_data.empty() && (fk_data.size(1) != first.size(0) || fk_data.size(2) != first.size(1) || fk_data.size(3) != first.size(2))) {
+        std::cerr << "Размеры basis (" << shape_text(fk_data.size(1), fk_data.size(2), fk_data.size(3))
+                  << ") и мариограмм (" << shape_text(first.size(0), first.size(1), first.size(2)) << ") различаются" << std::endl;
+        return false;
+    }
+    return true;
+}
+
 #endif // MANAGERS_H
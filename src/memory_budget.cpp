@@ -0,0 +1,79 @@
+#include "memory_budget.h"
+#include "factor_cache.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+MemoryFootprint estimate_footprint(const MemoryModel& model) {
+    MemoryFootprint footprint;
+    const size_t series = model.T * model.element_size; // один ряд wave или basis
+
+    // Пакет: мариограммы, basis и носители (begin/end на пиксель и базисную функцию)
+    size_t batch_row = model.width * (model.n_basis * series + 2 * model.n_basis * sizeof(int));
+    if (!model.resident_waves) {
+        batch_row += model.width * model.n_waves * series;
+    }
+    // Конвейер: до depth пакетов в очереди к решению или в чтении (чтение ждёт места в очереди
+    // до начала работы) и пакет в решении
+    const size_t depth = static_cast<size_t>(std::max(0, model.queue_depth));
+    footprint.per_row = batch_row * (depth > 0 ? depth + 1 : 1);
+    if (model.transpose_basis) {
+        footprint.per_row += model.width * model.n_basis * series;
+    }
+    // Буферы чтения: у каждого потока — срез одного basis-файла
+    footprint.per_row += model.width * static_cast<size_t>(std::max(1, model.io_workers)) * series;
+    // Записи кэша разложений, как и строки результата, ждут стадии записи
+    const size_t written_batches = depth > 0 ? depth + 2 : 1;
+    if (model.write_factor_cache) {
+        footprint.per_row += model.width * factor_record_size(static_cast<int>(model.n_basis), static_cast<int>(model.T)) * sizeof(double)
+            * written_batches;
+    }
+
+    // Результат: коэффициенты и ошибка на пиксель (с заголовком выделения) — за весь проход или
+    // только строки пакетов между решением и записью
+    const size_t result_row = model.width * model.n_waves * ((model.n_basis + 1) * sizeof(double) + 48);
+    if (model.stream_results) {
+        footprint.per_row += result_row * written_batches;
+    } else {
+        footprint.fixed = model.height * result_row;
+    }
+    // Рабочие массивы решателя в каждом потоке пула: basis, ортогональный базис, сигналы
+    footprint.fixed += (2 * model.n_basis + model.n_waves + 3) * model.T * sizeof(double)
+        * static_cast<size_t>(std::max(1, model.lanes)) * static_cast<size_t>(std::max(1, model.threads));
+    footprint.fixed += model.tile_scratch * static_cast<size_t>(std::max(1, model.threads));
+    if (model.resident_waves) {
+        footprint.fixed += model.height * model.width * model.n_waves * series;
+    }
+    return footprint;
+}
+
+int rows_for_budget(const MemoryFootprint& footprint, size_t budget, int max_rows) {
+    if (footprint.per_row == 0 || budget <= footprint.fixed) return 1;
+    size_t rows = (budget - footprint.fixed) / footprint.per_row;
+    return static_cast<int>(std::max<size_t>(1, std::min<size_t>(rows, static_cast<size_t>(std::max(1, max_rows)))));
+}
+
+#ifdef _WIN32
+size_t peak_rss_bytes() {
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.PeakWorkingSetSize;
+}
+#else
+size_t peak_rss_bytes() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024; // в КБ
+#endif
+}
+#endif
@@ -0,0 +1,43 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <cstddef>
+
+// Размеры расчёта, от которых зависит занимаемая память
+struct MemoryModel {
+    size_t n_basis = 0;
+    size_t n_waves = 1;
+    size_t T = 0;                 // отсчётов во временном окне
+    size_t width = 0;             // пикселей в строке области
+    size_t height = 0;            // строк области
+    size_t element_size = 8;      // байт на отсчёт wave и basis в памяти (double или float)
+    int lanes = 1;                // пикселей в одном решении (пакетное ядро)
+    int threads = 1;              // потоков решения, у каждого своя рабочая память
+    size_t tile_scratch = 0;      // буфер упакованного блока basis плитки в каждом потоке
+    int io_workers = 1;           // потоков чтения basis, у каждого свой буфер
+    int queue_depth = 1;          // пакетов в очереди между стадиями конвейера (pipeline.h); 0 — стадии по очереди
+    bool stream_results = false;  // результат пишется по пакетам, а не копится за весь проход
+    bool transpose_basis = false; // basis пакета переставляется в другую раскладку: на время копирования — две копии
+    bool resident_waves = false;  // мариограммы всей области уже в памяти (wave_cache.h)
+    bool write_factor_cache = false;
+};
+
+// Оценка памяти: fixed не зависит от высоты пакета (результат, если он копится, рабочая память
+// потоков, мариограммы всей области),
+// per_row — на строку области в пакете, с учётом всех пакетов конвейера
+struct MemoryFootprint {
+    size_t fixed = 0;
+    size_t per_row = 0;
+    size_t bytes(int rows) const { return fixed + per_row * static_cast<size_t>(rows); }
+};
+
+MemoryFootprint estimate_footprint(const MemoryModel& model);
+
+// Наибольшая высота пакета (в строках области, не больше max_rows), при которой оценка
+// не превышает budget байт; не меньше 1, даже если бюджет меньше fixed
+int rows_for_budget(const MemoryFootprint& footprint, size_t budget, int max_rows);
+
+// Наибольший объём физической памяти процесса за время работы (байт); 0 — неизвестен
+size_t peak_rss_bytes();
+
+#endif // MEMORY_BUDGET_H
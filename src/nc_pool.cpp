@@ -0,0 +1,138 @@
+#include "nc_pool.h"
+#include <netcdf.h>
+#include <iostream>
+#include <mutex>
+
+#ifdef NETCDF_THREADSAFE
+NcLock::NcLock() {}
+NcLock::~NcLock() {}
+#else
+// Рекурсивный: вызовы под блокировкой (например, закрытие файла при открытии нового) могут вкладываться
+static std::recursive_mutex& netcdf_mutex() {
+    static std::recursive_mutex mutex;
+    return mutex;
+}
+NcLock::NcLock() { netcdf_mutex().lock(); }
+NcLock::~NcLock() { netcdf_mutex().unlock(); }
+#endif
+
+NcHandlePool::~NcHandlePool() {
+    close_all();
+}
+
+// Открытие файла и разбор переменной "height"
+static int open_variable(const std::string& path, NcVariable& variable) {
+    NcLock nc_lock;
+    int ncid;
+    int retval = nc_open(path.c_str(), NC_NOWRITE, &ncid);
+    if (retval != NC_NOERR) {
+        std::cerr << "Ошибка открытия файла " << path << " : " << nc_strerror(retval) << std::endl;
+        return retval;
+    }
+
+    int varid;
+    retval = nc_inq_varid(ncid, "height", &varid);
+    if (retval != NC_NOERR) {
+        std::cerr << "Переменная 'height' не найдена в " << path << std::endl;
+        nc_close(ncid);
+        return retval;
+    }
+
+    int ndims;
+    nc_inq_varndims(ncid, varid, &ndims);
+    if (ndims != 3) {
+        std::cerr << "Ожидалось 3 измерения в файле " << path << std::endl;
+        nc_close(ncid);
+        return NC_EINVAL;
+    }
+
+    int dimids[3];
+    nc_inq_vardimid(ncid, varid, dimids);
+    nc_inq_dimlen(ncid, dimids[0], &variable.T);
+    nc_inq_dimlen(ncid, dimids[1], &variable.Y);
+    nc_inq_dimlen(ncid, dimids[2], &variable.X);
+    variable.ncid = ncid;
+    variable.varid = varid;
+    return NC_NOERR;
+}
+
+int NcHandlePool::acquire(const std::string& path, NcVariable& variable) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(path);
+    if (it != entries_.end()) {
+        it->second.last_use = ++clock_;
+        variable = it->second.variable;
+        return NC_NOERR;
+    }
+
+    if (max_open_ > 0 && entries_.size() >= max_open_) {
+        evict_least_recent();
+    }
+    Entry entry;
+    int retval = open_variable(path, entry.variable);
+    if (retval != NC_NOERR) return retval;
+    ++total_opens_;
+    apply_chunk_cache(entry.variable);
+    entry.last_use = ++clock_;
+    variable = entry.variable;
+    entries_.emplace(path, entry);
+    return NC_NOERR;
+}
+
+void NcHandlePool::set_chunk_cache(size_t bytes, size_t slots, float preemption) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    chunk_cache_bytes_ = bytes;
+    chunk_cache_slots_ = slots;
+    chunk_cache_preemption_ = preemption;
+    for (const auto& entry : entries_) {
+        apply_chunk_cache(entry.second.variable);
+    }
+}
+
+void NcHandlePool::apply_chunk_cache(const NcVariable& variable) const {
+    if (chunk_cache_bytes_ == 0) return;
+    NcLock nc_lock;
+    int retval = nc_set_var_chunk_cache(variable.ncid, variable.varid, chunk_cache_bytes_, chunk_cache_slots_, chunk_cache_preemption_);
+    if (retval != NC_NOERR) {
+        std::cerr << "Не удалось задать кэш блоков: " << nc_strerror(retval) << std::endl;
+    }
+}
+
+void NcHandlePool::evict_least_recent() {
+    auto oldest = entries_.begin();
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->second.last_use < oldest->second.last_use) oldest = it;
+    }
+    if (oldest == entries_.end()) return;
+    NcLock nc_lock;
+    nc_close(oldest->second.variable.ncid);
+    entries_.erase(oldest);
+}
+
+void NcHandlePool::close(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(path);
+    if (it == entries_.end()) return;
+    NcLock nc_lock;
+    nc_close(it->second.variable.ncid);
+    entries_.erase(it);
+}
+
+void NcHandlePool::close_all() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    NcLock nc_lock;
+    for (auto& entry : entries_) {
+        nc_close(entry.second.variable.ncid);
+    }
+    entries_.clear();
+}
+
+size_t NcHandlePool::open_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+size_t NcHandlePool::total_opens() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return total_opens_;
+}
@@ -0,0 +1,83 @@
+#ifndef NC_POOL_H
+#define NC_POOL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Открытый NetCDF-файл с разобранными метаданными переменной "height" [T][Y][X]
+struct NcVariable {
+    int ncid = -1;
+    int varid = -1;
+    size_t T = 0;
+    size_t Y = 0;
+    size_t X = 0;
+};
+
+// Блокировка вызовов библиотеки NetCDF на время жизни объекта — одна на процесс. Обычные сборки
+// NetCDF-C/HDF5 хранят общее глобальное состояние для всех открытых файлов, поэтому отдельные ncid
+// у потоков одновременную работу не разрешают. Со сборкой NETCDF_THREADSAFE (NetCDF поверх
+// потокобезопасной HDF5) не блокирует, и потоки чтения basis работают параллельно
+class NcLock {
+public:
+    NcLock();
+    ~NcLock();
+    NcLock(const NcLock&) = delete;
+    NcLock& operator=(const NcLock&) = delete;
+};
+
+// Ограничение числа одновременно открытых NetCDF-файлов по умолчанию
+constexpr size_t default_max_open_nc_files = 64;
+
+// Пул открытых NetCDF-файлов. Файл открывается и разбирается (varid, размеры) один раз и
+// остаётся открытым между y-пакетами, вместе с кэшем блоков HDF5. Если открыто max_open файлов,
+// перед открытием нового закрывается тот, что дольше всех не использовался.
+// Пул можно использовать из нескольких потоков: все вызовы NetCDF (и чтение через его дескрипторы)
+// идут под NcLock.
+class NcHandlePool {
+public:
+    explicit NcHandlePool(size_t max_open = default_max_open_nc_files) : max_open_(max_open) {}
+    ~NcHandlePool();
+    NcHandlePool(const NcHandlePool&) = delete;
+    NcHandlePool& operator=(const NcHandlePool&) = delete;
+
+    // Дескриптор и метаданные файла path (открывается при первом обращении).
+    // Возвращает NC_NOERR или код ошибки NetCDF (сообщение выводится в std::cerr)
+    int acquire(const std::string& path, NcVariable& variable);
+
+    // Размер кэша блоков HDF5 переменной (nc_set_var_chunk_cache) для открытых и всех
+    // открываемых далее файлов; bytes = 0 — настройка NetCDF по умолчанию
+    void set_chunk_cache(size_t bytes, size_t slots, float preemption);
+
+    // Закрыть файл path, если он открыт
+    void close(const std::string& path);
+    // Закрыть все файлы пула
+    void close_all();
+
+    size_t open_count() const;
+    // Сколько раз файлы открывались за время жизни пула
+    size_t total_opens() const;
+
+private:
+    struct Entry {
+        NcVariable variable;
+        uint64_t last_use = 0;
+    };
+
+    void evict_least_recent();
+
+    void apply_chunk_cache(const NcVariable& variable) const;
+
+    size_t max_open_;
+    size_t chunk_cache_bytes_ = 0;
+    size_t chunk_cache_slots_ = 0;
+    float chunk_cache_preemption_ = 0;
+    uint64_t clock_ = 0;
+    size_t total_opens_ = 0;
+    std::unordered_map<std::string, Entry> entries_;
+    mutable std::mutex mutex_;
+};
+
+#endif // NC_POOL_H
@@ -0,0 +1,259 @@
+#include "packed_basis.h"
+#include "fingerprint.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+static const char packed_basis_magic[8] = { 'T', 'S', 'B', 'A', 'S', 'I', 'S', '\0' };
+
+// Объём одного пакета при упаковке
+constexpr size_t packed_batch_bytes = size_t(256) << 20;
+
+static uint64_t align_up(uint64_t offset) {
+    return (offset + packed_basis_alignment - 1) / packed_basis_alignment * packed_basis_alignment;
+}
+
+// Поэлементное копирование с приведением типа (последнее измерение — быстрее всех)
+template <typename Target, typename Source, int Rank>
+static void copy_elements(const TensorView<Target, Rank>& target, const TensorView<const Source, Rank>& source) {
+    size_t count = 1;
+    for (int d = 0; d < Rank; d++) count *= source.size(d);
+    std::array<size_t, Rank> index{};
+    for (size_t n = 0; n < count; n++) {
+        size_t from = 0, to = 0;
+        for (int d = 0; d < Rank; d++) {
+            from += index[d] * source.stride(d);
+            to += index[d] * target.stride(d);
+        }
+        target.data[to] = static_cast<Target>(source.data[from]);
+        for (int d = Rank - 1; d >= 0 && ++index[d] == source.size(d); d--) index[d] = 0;
+    }
+}
+
+// Упаковка пакетами по y в типе Scalar
+template <typename Scalar>
+static bool write_packed(BasisManager& basis_manager, WaveManager* wave_manager, const NcStorage& storage,
+    std::ofstream& ofs, const PackedBasisHeader& header) {
+    const size_t n = header.n_basis, T = header.T, Y = header.Y, X = header.X;
+    const size_t pixel_bytes = n * T * sizeof(Scalar);
+    int batch_rows = static_cast<int>(std::max<size_t>(1, packed_batch_bytes / (pixel_bytes * X)));
+    RegionOfInterest all{ 0, static_cast<int>(X), 0, static_cast<int>(Y) };
+    BatchPlan plan = basis_manager.plan_batches(all, batch_rows);
+    print_batch_plan(storage, plan, 1);
+
+    std::vector<Scalar> wave_rows;
+    for (const auto& rows : plan.batches) {
+        RegionOfInterest region = all.rows(rows.first, rows.second);
+        // Раскладка PixelMajor на всю ширину — ровно байты файла для строк [y_start, y_end)
+        Field4D<Scalar> fk = basis_manager.get_fk_region<Scalar>(region);
+        if (fk.empty() || fk.size(0) != n || fk.size(1) != T || fk.size(3) != X) {
+            std::cerr << "Не удалось прочитать basis для y [" << rows.first << ", " << rows.second << ")" << std::endl;
+            return false;
+        }
+        ofs.seekp(static_cast<std::streamoff>(header.basis_offset + rows.first * X * pixel_bytes));
+        ofs.write(reinterpret_cast<const char*>(fk.data()), static_cast<std::streamsize>(fk.size(2) * X * pixel_bytes));
+
+        if (wave_manager) {
+            const Field3D<Scalar> wave = wave_manager->load_mariogramm_by_region<Scalar>(region);
+            if (wave.empty() || wave.size(0) != T || wave.size(1) != fk.size(2) || wave.size(2) != X) {
+                std::cerr << "Размеры мариограмм не совпадают с basis для y [" << rows.first << ", " << rows.second << ")" << std::endl;
+                return false;
+            }
+            // [t][i][x] -> [i][t][x]
+            const size_t height = wave.size(1);
+            wave_rows.resize(height * T * X);
+            TensorView<Scalar, 3> target{ wave_rows.data(), { T, height, X }, { X, T * X, 1 } };
+            copy_elements<Scalar, Scalar, 3>(target, wave.view());
+            ofs.seekp(static_cast<std::streamoff>(header.wave_offset + rows.first * T * X * sizeof(Scalar)));
+            ofs.write(reinterpret_cast<const char*>(wave_rows.data()), static_cast<std::streamsize>(wave_rows.size() * sizeof(Scalar)));
+        }
+        if (!ofs) {
+            std::cerr << "Ошибка записи упакованного файла" << std::endl;
+            return false;
+        }
+        std::cout << "packed rows [" << rows.first << ", " << rows.second << ") of " << Y << "\n";
+    }
+    return true;
+}
+
+bool convert_basis_folder(const std::string& basis_folder, const std::string& wave_file,
+    const std::string& out_path, size_t element_size) {
+    if (element_size != sizeof(float) && element_size != sizeof(double)) {
+        std::cerr << "Неверный размер элемента: " << element_size << std::endl;
+        return false;
+    }
+    BasisManager basis_manager(basis_folder);
+    basis_manager.layout = BasisLayout::PixelMajor;
+    std::vector<fs::path> files = basis_manager.files();
+    if (files.empty()) {
+        std::cerr << "В папке " << basis_folder << " нет basis-файлов" << std::endl;
+        return false;
+    }
+    NcStorage storage;
+    if (!basis_manager.inspect(storage) || storage.shape[0] == 0 || storage.shape[1] == 0 || storage.shape[2] == 0) {
+        std::cerr << "Не удалось определить размеры basis-файлов в " << basis_folder << std::endl;
+        return false;
+    }
+
+    std::ostringstream names;
+    for (const auto& file : files) {
+        names << file.filename().string() << "\n";
+    }
+    std::unique_ptr<WaveManager> wave_manager;
+    if (!wave_file.empty()) {
+        wave_manager = std::make_unique<WaveManager>(wave_file);
+        names << fs::path(wave_file).filename().string() << "\n";
+    }
+
+    PackedBasisHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, packed_basis_magic, sizeof(header.magic));
+    header.version = packed_basis_version;
+    header.element_size = static_cast<uint32_t>(element_size);
+    header.n_basis = files.size();
+    header.T = storage.shape[0];
+    header.Y = storage.shape[1];
+    header.X = storage.shape[2];
+    header.basis_hash = fingerprint_files(files);
+    header.wave_hash = wave_manager ? fingerprint_file(wave_file) : 0;
+    std::string names_text = names.str();
+    header.names_offset = sizeof(header);
+    header.names_size = names_text.size();
+    header.basis_offset = align_up(header.names_offset + header.names_size);
+    uint64_t basis_bytes = header.n_basis * header.T * header.Y * header.X * element_size;
+    header.wave_offset = wave_manager ? align_up(header.basis_offset + basis_bytes) : 0;
+
+    std::error_code ec;
+    if (fs::path(out_path).has_parent_path()) {
+        fs::create_directories(fs::path(out_path).parent_path(), ec);
+    }
+    std::string tmp_path = out_path + ".tmp";
+    {
+        std::ofstream ofs(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!ofs.is_open()) {
+            std::cerr << "Не удалось открыть файл " << tmp_path << " для записи.\n";
+            return false;
+        }
+        ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        ofs.write(names_text.data(), static_cast<std::streamsize>(names_text.size()));
+        bool written = (element_size == sizeof(float))
+            ? write_packed<float>(basis_manager, wave_manager.get(), storage, ofs, header)
+            : write_packed<double>(basis_manager, wave_manager.get(), storage, ofs, header);
+        if (!written) {
+            ofs.close();
+            fs::remove(tmp_path, ec);
+            return false;
+        }
+    }
+    fs::rename(tmp_path, out_path, ec);
+    if (ec) {
+        std::cerr << "Не удалось переименовать " << tmp_path << ": " << ec.message() << "\n";
+        return false;
+    }
+    std::cout << "packed " << files.size() << " basis files into " << out_path << "\n";
+    return true;
+}
+
+bool PackedBasis::open(const std::string& path) {
+    if (!file_.open(path)) return false;
+    if (file_.size() < sizeof(PackedBasisHeader)) {
+        std::cerr << "Файл " << path << " не является упакованным basis" << std::endl;
+        file_.close();
+        return false;
+    }
+    std::memcpy(&header_, file_.data(), sizeof(header_));
+    bool valid = std::memcmp(header_.magic, packed_basis_magic, sizeof(header_.magic)) == 0
+        && header_.version == packed_basis_version
+        && (header_.element_size == sizeof(float) || header_.element_size == sizeof(double));
+    uint64_t basis_bytes = header_.n_basis * header_.T * header_.Y * header_.X * header_.element_size;
+    uint64_t wave_bytes = header_.T * header_.Y * header_.X * header_.element_size;
+    valid = valid && header_.names_offset + header_.names_size <= file_.size()
+        && header_.basis_offset + basis_bytes <= file_.size()
+        && (header_.wave_offset == 0 || header_.wave_offset + wave_bytes <= file_.size());
+    if (!valid) {
+        std::cerr << "Файл " << path << " повреждён или другой версии" << std::endl;
+        file_.close();
+        return false;
+    }
+
+    std::istringstream names(std::string(file_.data() + header_.names_offset, header_.names_size));
+    std::string name;
+    basis_names_.clear();
+    wave_name_.clear();
+    while (std::getline(names, name)) {
+        if (basis_names_.size() < header_.n_basis) {
+            basis_names_.push_back(name);
+        } else {
+            wave_name_ = name;
+        }
+    }
+    return true;
+}
+
+bool PackedBasis::clip(const RegionOfInterest& region, RegionOfInterest& clipped) const {
+    if (!clip_to_shape(region, header_.T, header_.Y, header_.X, clipped)) {
+        std::cerr << "Регион x [" << region.x0 << ", " << region.x1 << "), y [" << region.y0 << ", " << region.y1
+                  << "), t [" << region.t0 << ", " << region.t1 << ") вне упакованного файла" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Представление отображённых данных с шагами strides; если тип файла другой — копия с
+// приведением типа в раскладке copy_strides
+template <typename Scalar, int Rank>
+static Tensor<Scalar, Rank> mapped_tensor(std::shared_ptr<const PackedBasis> owner, const char* bytes, size_t element_size,
+    const std::array<size_t, Rank>& shape, const std::array<size_t, Rank>& strides, const std::array<size_t, Rank>& copy_strides) {
+    if (element_size == sizeof(Scalar)) {
+        Scalar* data = reinterpret_cast<Scalar*>(const_cast<char*>(bytes));
+        return Tensor<Scalar, Rank>(data, shape, strides, std::move(owner));
+    }
+    Tensor<Scalar, Rank> copy(shape, copy_strides);
+    if (element_size == sizeof(float)) {
+        copy_elements<Scalar, float, Rank>(copy.view(), TensorView<const float, Rank>{ reinterpret_cast<const float*>(bytes), shape, strides });
+    } else {
+        copy_elements<Scalar, double, Rank>(copy.view(), TensorView<const double, Rank>{ reinterpret_cast<const double*>(bytes), shape, strides });
+    }
+    return copy;
+}
+
+template <typename Scalar>
+Field4D<Scalar> PackedBasis::basis_region(const RegionOfInterest& region) const {
+    RegionOfInterest clipped;
+    if (!clip(region, clipped)) return Field4D<Scalar>();
+    const size_t n = header_.n_basis, T = header_.T, X = header_.X;
+    std::array<size_t, 4> shape = { n, static_cast<size_t>(clipped.duration()),
+        static_cast<size_t>(clipped.height()), static_cast<size_t>(clipped.width()) };
+    // Шаги полного массива (b, t, y, x) в раскладке PixelMajor, по t, y и x — с учётом шагов области
+    std::array<size_t, 4> strides = { 1, clipped.t_stride * n, clipped.y_stride * X * T * n, clipped.x_stride * T * n };
+    const char* bytes = file_.data() + header_.basis_offset
+        + ((static_cast<size_t>(clipped.y0) * X + clipped.x0) * T + clipped.t0) * n * header_.element_size;
+    return mapped_tensor<Scalar, 4>(shared_from_this(), bytes, header_.element_size, shape, strides,
+        basis_strides(shape, BasisLayout::PixelMajor));
+}
+
+template <typename Scalar>
+Field3D<Scalar> PackedBasis::wave_region(const RegionOfInterest& region) const {
+    if (!has_wave()) return Field3D<Scalar>();
+    RegionOfInterest clipped;
+    if (!clip(region, clipped)) return Field3D<Scalar>();
+    const size_t T = header_.T, X = header_.X;
+    std::array<size_t, 3> shape = { static_cast<size_t>(clipped.duration()),
+        static_cast<size_t>(clipped.height()), static_cast<size_t>(clipped.width()) };
+    // Массив [y][t][x]
+    std::array<size_t, 3> strides = { clipped.t_stride * X, clipped.y_stride * T * X, static_cast<size_t>(clipped.x_stride) };
+    const char* bytes = file_.data() + header_.wave_offset
+        + ((static_cast<size_t>(clipped.y0) * T + clipped.t0) * X + clipped.x0) * header_.element_size;
+    return mapped_tensor<Scalar, 3>(shared_from_this(), bytes, header_.element_size, shape, strides,
+        Field3D<Scalar>::row_major_strides(shape));
+}
+
+template Field4D<double> PackedBasis::basis_region<double>(const RegionOfInterest&) const;
+template Field4D<float> PackedBasis::basis_region<float>(const RegionOfInterest&) const;
+template Field3D<double> PackedBasis::wave_region<double>(const RegionOfInterest&) const;
+template Field3D<float> PackedBasis::wave_region<float>(const RegionOfInterest&) const;
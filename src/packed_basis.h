@@ -0,0 +1,75 @@
+#ifndef PACKED_BASIS_H
+#define PACKED_BASIS_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "mapped_file.h"
+#include "managers.h"
+
+// Упакованный basis: basis-папка (и файл мариограмм) один раз переписываются из NetCDF в один
+// двоичный файл с раскладкой по пикселям. Файл отображается в память, и регионы выдаются
+// представлениями без копирования: повторный запуск стоит подкачки страниц вместо распаковки NetCDF.
+//
+// Файл: PackedBasisHeader, имена файлов (basis по порядку, затем wave; через '\n'), затем с
+// выравниванием packed_basis_alignment:
+//   basis [Y][X][T][n_basis] — блок n_basis x T каждого пикселя непрерывен (BasisLayout::PixelMajor)
+//   wave  [Y][T][X]          — строки подряд, чтобы пакеты по y были непрерывны
+
+constexpr uint32_t packed_basis_version = 1;
+constexpr size_t packed_basis_alignment = 4096;
+
+struct PackedBasisHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t element_size;  // 4 — float, 8 — double
+    uint64_t n_basis;
+    uint64_t T;
+    uint64_t Y;
+    uint64_t X;
+    uint64_t basis_hash;    // fingerprint_files(basis-файлы): сверяется с папкой, если она есть
+    uint64_t wave_hash;     // fingerprint_file(wave)
+    uint64_t names_offset;
+    uint64_t names_size;
+    uint64_t basis_offset;
+    uint64_t wave_offset;   // 0 — wave не записан
+};
+
+// Упаковка basis-папки basis_folder и файла мариограмм wave_file (пусто — без wave) в out_path.
+// Файлы читаются пакетами по y, в памяти — один пакет; element_size — 4 (float) или 8 (double).
+// Запись идёт во временный файл, который затем переименовывается
+bool convert_basis_folder(const std::string& basis_folder, const std::string& wave_file,
+    const std::string& out_path, size_t element_size);
+
+// Открытый упакованный файл. Представления держат его через shared_ptr, поэтому объект
+// создаётся только через std::make_shared
+class PackedBasis : public std::enable_shared_from_this<PackedBasis> {
+public:
+    // Открыть и проверить заголовок; false при ошибке (сообщение выводится в std::cerr)
+    bool open(const std::string& path);
+
+    const PackedBasisHeader& header() const { return header_; }
+    const std::vector<std::string>& basis_names() const { return basis_names_; }
+    const std::string& wave_name() const { return wave_name_; }
+    bool has_wave() const { return header_.wave_offset != 0; }
+
+    // basis для области region (обрезается по размерам) в раскладке PixelMajor. Если Scalar совпадает
+    // с типом файла — представление отображённой памяти (только для чтения), иначе — копия
+    template <typename Scalar>
+    Field4D<Scalar> basis_region(const RegionOfInterest& region) const;
+
+    // Мариограммы для области region, логически (t, i, x), как WaveManager::load_mariogramm_by_region
+    template <typename Scalar>
+    Field3D<Scalar> wave_region(const RegionOfInterest& region) const;
+
+private:
+    bool clip(const RegionOfInterest& region, RegionOfInterest& clipped) const;
+
+    MappedFile file_;
+    PackedBasisHeader header_{};
+    std::vector<std::string> basis_names_;
+    std::string wave_name_;
+};
+
+#endif // PACKED_BASIS_H
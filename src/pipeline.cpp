@@ -0,0 +1,23 @@
+#include "pipeline.h"
+#include <iomanip>
+#include <iostream>
+
+void print_pipeline_stats(const std::vector<StageStats>& stages, const std::vector<QueueStats>& queues, double wall_seconds) {
+    if (stages.empty()) return;
+    std::cout << "pipeline: " << wall_seconds << " s wall\n";
+    const StageStats* bottleneck = &stages[0];
+    for (const auto& stage : stages) {
+        std::cout << "  " << std::left << std::setw(8) << stage.name << std::right << stage.batches << " batches, "
+                  << stage.rows << " rows, busy " << stage.busy_seconds << " s ("
+                  << (stage.busy_seconds > 0 ? stage.rows / stage.busy_seconds : 0) << " rows/s), waited for input "
+                  << stage.starved_seconds << " s, for output " << stage.blocked_seconds << " s\n";
+        if (stage.busy_seconds > bottleneck->busy_seconds) bottleneck = &stage;
+    }
+    for (const auto& queue : queues) {
+        std::cout << "  queue " << queue.name << ": mean " << queue.mean_size << ", max " << queue.max_size
+                  << " of " << queue.capacity << " (" << queue.pushed << " batches)\n";
+    }
+    // Стадия, занятая дольше всех, задаёт темп: остальные ждут её на своих очередях
+    std::cout << "  bottleneck: " << bottleneck->name << " (busy "
+              << (wall_seconds > 0 ? 100 * bottleneck->busy_seconds / wall_seconds : 0) << "% of wall)\n";
+}
@@ -0,0 +1,133 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Конвейер расчёта: стадии (чтение с перестановкой, решение, запись) работают в своих потоках и
+// передают пакеты через очереди ограниченной ёмкости. Полная очередь останавливает стадию перед
+// ней, поэтому в памяти не больше пакетов, чем помещается в очереди и в работу стадий
+
+// Заполненность очереди за время её жизни
+struct QueueStats {
+    std::string name;
+    size_t capacity = 0;
+    size_t max_size = 0;
+    double mean_size = 0; // средняя по времени
+    size_t pushed = 0;
+};
+
+// Очередь ограниченной ёмкости между двумя стадиями (один производитель, один потребитель)
+template <typename T>
+class BoundedQueue {
+public:
+    BoundedQueue(std::string name, size_t capacity)
+        : name_(std::move(name)), capacity_(capacity < 1 ? 1 : capacity),
+          created_(std::chrono::steady_clock::now()), changed_(created_) {}
+
+    // Дождаться свободного места, ничего не добавляя: производитель готовит пакет только тогда,
+    // когда его есть куда положить, и не держит в памяти лишний готовый пакет
+    void wait_for_space() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this] { return items_.size() < capacity_; });
+    }
+
+    void push(T item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this] { return items_.size() < capacity_; });
+        account();
+        items_.push_back(std::move(item));
+        pushed_++;
+        max_size_ = std::max(max_size_, items_.size());
+        not_empty_.notify_one();
+    }
+
+    // false — очередь закрыта и пуста
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+        if (items_.empty()) return false;
+        account();
+        item = std::move(items_.front());
+        items_.pop_front();
+        not_full_.notify_one();
+        return true;
+    }
+
+    // Больше элементов не будет: pop вернёт false, когда очередь опустеет
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        account();
+        closed_ = true;
+        not_empty_.notify_all();
+    }
+
+    QueueStats stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        QueueStats stats;
+        stats.name = name_;
+        stats.capacity = capacity_;
+        stats.max_size = max_size_;
+        stats.pushed = pushed_;
+        double lifetime = std::chrono::duration<double>(changed_ - created_).count();
+        stats.mean_size = lifetime > 0 ? size_seconds_ / lifetime : 0;
+        return stats;
+    }
+
+private:
+    // Накопление размер x время до текущего изменения (под mutex_)
+    void account() {
+        auto now = std::chrono::steady_clock::now();
+        size_seconds_ += items_.size() * std::chrono::duration<double>(now - changed_).count();
+        changed_ = now;
+    }
+
+    std::string name_;
+    size_t capacity_;
+    mutable std::mutex mutex_;
+    std::condition_variable not_full_;
+    std::condition_variable not_empty_;
+    std::deque<T> items_;
+    bool closed_ = false;
+    size_t pushed_ = 0;
+    size_t max_size_ = 0;
+    double size_seconds_ = 0;
+    std::chrono::steady_clock::time_point created_;
+    std::chrono::steady_clock::time_point changed_;
+};
+
+// Счётчики стадии конвейера
+struct StageStats {
+    std::string name;
+    size_t batches = 0;
+    size_t rows = 0;
+    double busy_seconds = 0;    // обработка пакетов
+    double starved_seconds = 0; // ожидание пакета из входной очереди
+    double blocked_seconds = 0; // ожидание места в выходной очереди
+};
+
+// Замер длительности участка стадии: добавляет прошедшее время к seconds при выходе из области
+class StageTimer {
+public:
+    explicit StageTimer(double& seconds) : seconds_(seconds), begin_(std::chrono::steady_clock::now()) {}
+    ~StageTimer() { seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin_).count(); }
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+    double& seconds_;
+    std::chrono::steady_clock::time_point begin_;
+};
+
+// Отчёт: пропускная способность стадий (строк в секунду работы), ожидания, заполненность очередей
+// и самая загруженная стадия; wall_seconds — время работы всего конвейера
+void print_pipeline_stats(const std::vector<StageStats>& stages, const std::vector<QueueStats>& queues, double wall_seconds);
+
+#endif // PIPELINE_H
@@ -3,13 +3,74 @@
 
 #include <string>
 #include <vector>
+#include <limits>
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include "json.hpp"
 
+// Область расчёта в координатах NetCDF-файлов: строки [y0, y1) с шагом y_stride,
+// столбцы [x0, x1) с шагом x_stride и отсчёты времени [t0, t1) с шагом t_stride
+// (по умолчанию — вся запись). Из файлов читается ровно этот гиперсрез
+struct RegionOfInterest {
+    int x0 = 0;
+    int x1 = 0;
+    int y0 = 0;
+    int y1 = 0;
+    int x_stride = 1;
+    int y_stride = 1;
+    int t0 = 0;
+    int t1 = std::numeric_limits<int>::max(); // обрезается по длине записи
+    int t_stride = 1;
+
+    // Число столбцов, строк и отсчётов времени с учётом шагов
+    int width() const { return x1 > x0 ? (x1 - x0 + x_stride - 1) / x_stride : 0; }
+    int height() const { return y1 > y0 ? (y1 - y0 + y_stride - 1) / y_stride : 0; }
+    int duration() const { return t1 > t0 ? static_cast<int>((static_cast<long long>(t1) - t0 + t_stride - 1) / t_stride) : 0; }
+    // Пространственная часть пуста (временное окно не проверяется: до обрезки t1 может быть не задан)
+    bool empty() const { return width() == 0 || height() == 0; }
+    bool full_time() const { return t0 == 0 && t1 == std::numeric_limits<int>::max() && t_stride == 1; }
+
+    // Та же пространственная область с временным окном из other
+    RegionOfInterest with_time_of(const RegionOfInterest& other) const {
+        RegionOfInterest region = *this;
+        region.t0 = other.t0;
+        region.t1 = other.t1;
+        region.t_stride = other.t_stride;
+        return region;
+    }
+
+    // Подобласть из строк [y_begin, y_end) (y_begin — на сетке шага y_stride)
+    RegionOfInterest rows(int y_begin, int y_end) const {
+        RegionOfInterest region = *this;
+        region.y0 = y_begin;
+        region.y1 = y_end;
+        return region;
+    }
+
+    // Часть index из count: строки сетки области делятся на count почти равных непрерывных частей
+    RegionOfInterest shard(int index, int count) const {
+        const long long h = height();
+        const int first = static_cast<int>(h * index / count);
+        const int last = static_cast<int>(h * (index + 1) / count);
+        return rows(y0 + first * y_stride, last > first ? y0 + last * y_stride : y0 + first * y_stride);
+    }
+};
+
+// Область region, обрезанная по размерам поля [T][Y][X]; false — область пуста или задана неверно
+inline bool clip_to_shape(const RegionOfInterest& region, size_t T, size_t Y, size_t X, RegionOfInterest& clipped) {
+    clipped = region;
+    clipped.x1 = static_cast<int>(std::min(static_cast<size_t>(std::max(region.x1, 0)), X));
+    clipped.y1 = static_cast<int>(std::min(static_cast<size_t>(std::max(region.y1, 0)), Y));
+    clipped.t1 = static_cast<int>(std::min(static_cast<size_t>(std::max(region.t1, 0)), T));
+    if (region.x0 < 0 || region.y0 < 0 || region.t0 < 0) return false;
+    if (region.x_stride < 1 || region.y_stride < 1 || region.t_stride < 1) return false;
+    return !clipped.empty() && clipped.duration() > 0;
+}
+
 class AreaConfigurationInfo {
 public:
-    std::vector<int> all;              //  , , [width, height]
+    std::vector<int> all;              // размеры области, например, [width, height]
     std::vector<int> subduction_bounds;
     std::vector<int> mariogramm_bounds;
 
@@ -21,7 +82,7 @@ public:
     void load(const std::string& file_path) {
         std::ifstream ifs(file_path);
         if (!ifs.is_open()) {
-            std::cerr << "  : " << file_path << std::endl;
+            std::cerr << "Ошибка открытия файла: " << file_path << std::endl;
             return;
         }
         nlohmann::json j;
@@ -30,6 +91,27 @@ public:
         subduction_bounds = j["subduction_zone"].get<std::vector<int>>();
         mariogramm_bounds = j["mariogramm_zone"].get<std::vector<int>>();
     }
+
+    // Область расчёта по умолчанию: x в [0, width / 4), y в [75, height / 4)
+    RegionOfInterest default_region() const {
+        RegionOfInterest region;
+        if (all.size() < 2) return region;
+        region.x1 = all[0] / 4;
+        region.y0 = 75;
+        region.y1 = all[1] / 4;
+        return region;
+    }
+
+    // Область мариограмм из zones.json: mariogramm_zone = [x0, y0, x1, y1]
+    RegionOfInterest mariogramm_region() const {
+        RegionOfInterest region;
+        if (mariogramm_bounds.size() < 4) return region;
+        region.x0 = mariogramm_bounds[0];
+        region.y0 = mariogramm_bounds[1];
+        region.x1 = mariogramm_bounds[2];
+        region.y1 = mariogramm_bounds[3];
+        return region;
+    }
 };
 
 #endif // STABLE_DATA_STRUCTS_H
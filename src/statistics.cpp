@@ -1,132 +1,991 @@
 #include "statistics.h"
 #include "approx_orto.h"
+#include "approx_batch.h"
+#include "factor_cache.h"
+#include "fingerprint.h"
+#include "basis_support.h"
+#include "memory_budget.h"
+#include "pipeline.h"
+#include "checkpoint.h"
 #include <Eigen/Dense>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <future>
 #include <algorithm>
-#include "json.hpp"  //   nlohmann::json
+#include <type_traits>
+#include <chrono>
+#include <memory>
+#include <limits>
+#include <random>
+#include <cstdio>
+#include <thread>
+#include "json.hpp"  // Подключение библиотеки nlohmann::json
 
 using json = nlohmann::json;
 
-////      QR-
+//// Реализация неортогональной аппроксимации с использованием QR-разложения
 //std::pair<Eigen::VectorXd, Eigen::VectorXd> approximate_with_non_orthogonal_basis(const Eigen::VectorXd& x, const Eigen::MatrixXd& basis) {
-//    //     :
+//    // Решаем систему методом наименьших квадратов:
 //    Eigen::VectorXd coeffs = basis.transpose().colPivHouseholderQr().solve(x);
-//    //   (  )
+//    // Вычисляем аппроксимацию (не используется далее)
 //    Eigen::VectorXd approximation = basis.transpose() * coeffs;
 //    return { approximation, coeffs };
 //}
 
 //
-//  calculate_statistics
-//    NetCDF (WaveManager  BasisManager),     
-//    (wave_vector)    (smoothed_basis)  
-//     (non orto)     (orto).
+// Функция calculate_statistics
+// Загружает данные из NetCDF (WaveManager и BasisManager), затем для каждого пикселя региона
+// извлекает вектор времени (wave_vector) и соответствующий базис (smoothed_basis) и вычисляет
+// коэффициенты аппроксимации обычным методом (non orto) и методом с ортогонализацией (orto).
 //
 
 int count_from_name(const std::string& name) {
-    //    '_'
+    // Находим позицию символа '_'
     std::size_t underscorePos = name.find('_');
     if (underscorePos != std::string::npos) {
-        //    '_'
+        // Извлекаем подстроку после '_'
         std::string numberPart = name.substr(underscorePos + 1);
-        //    
+        // Преобразуем в целое число
         return std::stoi(numberPart);
     }
-    //  '_'  ,  0      
+    // Если '_' не найден, вернём 0 или любое другое значение по умолчанию
     return 0;
 }
 
-void calculate_statistics(const std::string& root_folder,
-    const std::string& bath,
-    const std::string& wave,
-    const std::string& basis,
-    const AreaConfigurationInfo& area_config,
-    CoeffMatrix& statistics_orto) {
-    //  
-    std::string basis_path = root_folder + "/" + bath + "/" + basis;
-    std::string wave_nc_path = root_folder + "/" + bath + "/" + wave + ".nc";
-
-    BasisManager basis_manager(basis_path);
-    WaveManager wave_manager(wave_nc_path);
-
-    int width = area_config.all[0];
-    int height = area_config.all[1];
-    int batch_size = 64*3*6/count_from_name(basis);
-    int y_start_init = 75;
-
-    statistics_orto.clear();
-
-    for (int y_start = y_start_init; y_start < height / 4; y_start += batch_size) {
-        int y_end = std::min(y_start + batch_size, height);
-        auto wave_data = wave_manager.load_mariogramm_by_region(y_start, y_end);
-        auto fk_data = basis_manager.get_fk_region(y_start, y_end);
-        if (wave_data.empty() || fk_data.empty()) continue;
-        int T = wave_data.size();
-        int region_height = wave_data[0].size();
-        int region_width = wave_data[0][0].size();
-        int n_basis = fk_data.size();
-
-        int x_max = width / 4;
-        std::cout << "loaded\n";
-
-        std::vector<std::future<std::vector<CoefficientData>>> futures;
-        futures.reserve(region_height);
-
-        for (int i = 0; i < region_height; i++) {
-            futures.push_back(std::async(std::launch::async, [i, T, x_max, n_basis, &wave_data, &fk_data]() -> std::vector<CoefficientData> {
-                std::vector<CoefficientData> row_data;
-                for (int x = 0; x < x_max; x++) {
-                    //       
-                    Eigen::VectorXd wave_vector(T);
-                    for (int t = 0; t < T; t++) {
-                        wave_vector[t] = wave_data[t][i][x];
-                    }
-                    //    (n_basis x T)
-                    Eigen::MatrixXd smoothed_basis(n_basis, T);
+// Результат для одной строки: [wave][x]
+using RowResult = std::vector<std::vector<CoefficientData>>;
+
+// Базис пикселя (n_basis x T) в хранилище Field4D: шаг по t — между столбцами, по b — между строками
+template <typename Scalar>
+using BasisBlock = Eigen::Map<const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic>, 0, Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>>;
+
+// Решение плитки строки i загруженного региона — пикселей x в [x_begin, x_end) — для всех сигналов
+// waves_data; результат пикселя x пишется в row_data[w][x] (строка уже нужного размера, плитки
+// одной строки не пересекаются). Данные хранятся в Scalar, накопление и решение — в double.
+// Базис пикселя (i, x) — fk_data(b, t, fk_i, x - fk_x0): fk_data может быть упакованным блоком плитки.
+// support — носители базисных функций (compute_basis_support по всему пакету).
+// factor_out (если задан) — записи кэша разложений для строки: по записи factor_record_size на пиксель
+template <typename Scalar>
+static void solve_tile(int i, int x_begin, int x_end,
+    const std::vector<Field3D<Scalar>>& waves_data,
+    const Field4D<Scalar>& fk_data, int fk_i, int fk_x0,
+    const BasisSupport& support,
+    OrtoKernel orto_kernel,
+    const StatisticsOptions& options,
+    double* factor_out,
+    RowResult& row_data) {
+    int n_waves = waves_data.size();
+    int T = waves_data[0].size(0);
+    int n_basis = fk_data.size(0);
+    // Рабочая память ядра: одна на поток, переиспользуется для всех пикселей
+    thread_local OrtoWorkspace workspace;
+    workspace.reserve(n_basis, T);
+    if (n_waves > 1 || factor_out != nullptr) {
+        workspace.reserve_waves(n_basis, T, n_waves);
+    }
+    size_t record_size = factor_record_size(n_basis, T);
+    int x = x_begin;
+    // Пакетный решатель: lanes соседних пикселей за раз, данные в раскладке [b][t][lane]
+    // (разложение в нём не сохраняется, поэтому при записи кэша не используется)
+    int lanes = options.batch_lanes;
+    if (options.solver == SolverKind::Orto && is_supported_batch_lanes(lanes) && factor_out == nullptr) {
+        workspace.reserve_batch<Scalar>(n_basis, T, lanes, n_waves);
+        BatchBuffers<Scalar>& batch = workspace.batch_buffers<Scalar>();
+        batch.explicit_residual = options.explicit_residual;
+        batch.reorder_by_support = options.support_threshold > 0;
+        for (; x + lanes <= x_end; x += lanes) {
+            // Носитель пакета — объединение носителей его пикселей
+            for (int b = 0; b < n_basis; b++) {
+                int begin = T, end = 0;
+                for (int l = 0; l < lanes; l++) {
+                    int pixel_begin = support.pixel_begin(i, x + l)[b];
+                    int pixel_end = support.pixel_end(i, x + l)[b];
+                    if (pixel_begin >= pixel_end) continue;
+                    begin = std::min(begin, pixel_begin);
+                    end = std::max(end, pixel_end);
+                }
+                batch.support_begin[b] = (begin < end) ? begin : 0;
+                batch.support_end[b] = (begin < end) ? end : 0;
+            }
+            for (int w = 0; w < n_waves; w++) {
+                for (int t = 0; t < T; t++) {
+                    std::copy_n(&waves_data[w](t, i, x), lanes, &batch.wave[(static_cast<size_t>(w) * T + t) * lanes]);
+                }
+            }
+            // Соседние пиксели подряд только в раскладке FileOrder, поэтому копирование — с шагом по x
+            const size_t x_stride = fk_data.stride(3);
+            for (int b = 0; b < n_basis; b++) {
+                for (int t = 0; t < T; t++) {
+                    const Scalar* src = &fk_data(b, t, fk_i, x - fk_x0);
+                    Scalar* dst = &batch.basis[(static_cast<size_t>(b) * T + t) * lanes];
+                    for (int l = 0; l < lanes; l++) dst[l] = src[l * x_stride];
+                }
+            }
+            approximate_batch_orto(n_basis, T, batch);
+            for (int w = 0; w < n_waves; w++) {
+                const double* coefs = &batch.coefs[static_cast<size_t>(w) * n_basis * lanes];
+                for (int l = 0; l < lanes; l++) {
+                    CoefficientData pixelData;
+                    pixelData.coefs.resize(n_basis);
                     for (int b = 0; b < n_basis; b++) {
-                        for (int t = 0; t < T; t++) {
-                            smoothed_basis(b, t) = fk_data[b][t][i][x];
-                        }
+                        pixelData.coefs[b] = coefs[static_cast<size_t>(b) * lanes + l];
                     }
-                    if (smoothed_basis.cols() != wave_vector.size()) continue;
+                    pixelData.aprox_error = batch.rmse[static_cast<size_t>(w) * lanes + l];
+                    row_data[w][x + l] = std::move(pixelData);
+                }
+            }
+        }
+    }
+    // Оставшиеся пиксели плитки (и все пиксели без пакетного режима) решаются по одному
+    for (; x < x_end; x++) {
+        // Сборка матрицы базиса (n_basis x T) прямо из хранилища fk_data с шагами его раскладки
+        // (в раскладке PixelMajor блок пикселя непрерывен)
+        Eigen::MatrixXd& smoothed_basis = workspace.basis;
+        smoothed_basis = BasisBlock<Scalar>(&fk_data(0, 0, fk_i, x - fk_x0), n_basis, T,
+            Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic>(fk_data.stride(1), fk_data.stride(0))).template cast<double>();
+        workspace.support_begin = Eigen::Map<const Eigen::VectorXi>(support.pixel_begin(i, x), n_basis);
+        workspace.support_end = Eigen::Map<const Eigen::VectorXi>(support.pixel_end(i, x), n_basis);
+        workspace.reorder_by_support = options.support_threshold > 0;
 
-                    //      
-                    Eigen::VectorXd coefs_orto = approximate_with_non_orthogonal_basis_orto(wave_vector, smoothed_basis);
+        if (n_waves > 1 || factor_out != nullptr) {
+            // Несколько сценариев: базис раскладывается один раз, все сигналы решаются вместе
+            for (int w = 0; w < n_waves; w++) {
+                for (int t = 0; t < T; t++) {
+                    workspace.waves(t, w) = waves_data[w](t, i, x);
+                }
+            }
+            if (options.solver == SolverKind::Gram && factor_out == nullptr) {
+                approximate_with_non_orthogonal_basis_gram_multi(workspace.waves, smoothed_basis, workspace);
+            } else {
+                orto_factor(smoothed_basis, workspace);
+                orto_solve_multi(workspace.waves, workspace);
+                if (factor_out != nullptr) {
+                    double* record = factor_out + static_cast<size_t>(x) * record_size;
+                    Eigen::Map<Matrix>(record, n_basis, n_basis) = workspace.R;
+                    Eigen::Map<Vector>(record + n_basis * n_basis, n_basis) = workspace.norms;
+                    Eigen::Map<RowMatrix>(record + n_basis * n_basis + n_basis, n_basis, T) = workspace.e;
+                }
+            }
+            if (options.explicit_residual) {
+                workspace.approximation_multi.noalias() = smoothed_basis.transpose() * workspace.coefs_multi;
+            }
+            for (int w = 0; w < n_waves; w++) {
+                CoefficientData pixelData;
+                pixelData.coefs = workspace.coefs_multi.col(w);
+                pixelData.aprox_error = options.explicit_residual
+                    ? std::sqrt((workspace.waves.col(w) - workspace.approximation_multi.col(w)).squaredNorm() / T)
+                    : workspace.rmse_multi[w];
+                row_data[w][x] = std::move(pixelData);
+            }
+            continue;
+        }
 
-                    //   :
-                    Eigen::VectorXd approximation = smoothed_basis.transpose() * coefs_orto;
-                    //    (RMSE)
-                    double error = std::sqrt((wave_vector - approximation).squaredNorm() / wave_vector.size());
+        // Сборка вектора значений сигнала для текущего пикселя
+        Eigen::VectorXd& wave_vector = workspace.wave;
+        for (int t = 0; t < T; t++) {
+            wave_vector[t] = waves_data[0](t, i, x);
+        }
 
-                    CoefficientData pixelData;
-                    pixelData.coefs = coefs_orto;
-                    pixelData.aprox_error = error;
-                    row_data.push_back(pixelData);
+        // Вычисление коэффициентов аппроксимации методом с ортогонализацией
+        if (options.solver == SolverKind::Gram) {
+            approximate_with_non_orthogonal_basis_gram(wave_vector, smoothed_basis, workspace);
+        } else {
+            orto_kernel(wave_vector, smoothed_basis, workspace);
+        }
+
+        // Среднеквадратичная ошибка (RMSE) считается ядром; явный остаток — только в режиме отладки
+        double error = workspace.rmse;
+        if (options.explicit_residual) {
+            workspace.approximation.noalias() = smoothed_basis.transpose() * workspace.coefs;
+            error = std::sqrt((wave_vector - workspace.approximation).squaredNorm() / wave_vector.size());
+        }
+
+        CoefficientData pixelData;
+        pixelData.coefs = workspace.coefs;
+        pixelData.aprox_error = error;
+        row_data[0][x] = std::move(pixelData);
+    }
+}
+
+// Решение всей строки i (пиксели [0, x_max)) одним потоком
+template <typename Scalar>
+static RowResult solve_row(int i, int x_max,
+    const std::vector<Field3D<Scalar>>& waves_data,
+    const Field4D<Scalar>& fk_data,
+    const BasisSupport& support,
+    OrtoKernel orto_kernel,
+    const StatisticsOptions& options) {
+    RowResult row_data(waves_data.size(), std::vector<CoefficientData>(x_max));
+    solve_tile(i, 0, x_max, waves_data, fk_data, i, 0, support, orto_kernel, options, nullptr, row_data);
+    return row_data;
+}
+
+// Объём упакованного блока basis плитки: вместе с рабочей памятью ядра помещается в L2
+constexpr size_t tile_scratch_bytes = size_t(512) << 10;
+
+// Форма плитки: width пикселей по x (целое число пакетов пикселей lanes) на rows строк.
+// Заданные размеры (options.tile_width/tile_rows) округляются до lanes; незаданные выбираются
+// так, чтобы блок basis плитки помещался в tile_scratch_bytes, а плиток было не меньше
+// четырёх на поток пула (иначе потокам нечего перехватывать)
+struct TileShape {
+    int width = 1;
+    int rows = 1;
+};
+
+static TileShape choose_tile_shape(const StatisticsOptions& options, int lanes, size_t n_basis, size_t T,
+    size_t element_size, int x_max, int region_height, int threads) {
+    TileShape shape;
+    int width = options.tile_width > 0 ? options.tile_width : 8;
+    shape.width = std::max(lanes, (width + lanes - 1) / lanes * lanes);
+    if (options.tile_rows > 0) {
+        shape.rows = options.tile_rows;
+    } else {
+        size_t row_bytes = static_cast<size_t>(shape.width) * n_basis * T * element_size;
+        shape.rows = static_cast<int>(std::max<size_t>(1, tile_scratch_bytes / std::max<size_t>(1, row_bytes)));
+        int tiles_per_row = (x_max + shape.width - 1) / shape.width;
+        long long max_rows = (static_cast<long long>(region_height) * tiles_per_row + 4LL * threads - 1) / (4LL * threads);
+        shape.rows = static_cast<int>(std::min<long long>(shape.rows, std::max(1LL, max_rows)));
+    }
+    shape.width = std::min(shape.width, std::max(lanes, (x_max + lanes - 1) / lanes * lanes));
+    shape.rows = std::max(1, std::min(shape.rows, region_height));
+    return shape;
+}
+
+// Плитка: строки [i_begin, i_end), пиксели [x_begin, x_end). Блок basis плитки сначала
+// копируется в непрерывный буфер потока в порядке [строка][b][t][x] (соседние пиксели подряд,
+// как у пакетного ядра), и все пиксели плитки решаются по нему, не обращаясь к пакету целиком.
+// factor_records — записи кэша разложений всего пакета (пусто — не пишутся)
+template <typename Scalar>
+static void solve_packed_tile(int i_begin, int i_end, int x_begin, int x_end,
+    const std::vector<Field3D<Scalar>>& waves_data,
+    const Field4D<Scalar>& fk_data,
+    const BasisSupport& support,
+    OrtoKernel orto_kernel,
+    const StatisticsOptions& options,
+    std::vector<double>& factor_records,
+    std::vector<RowResult>& rows) {
+    const size_t n_basis = fk_data.size(0);
+    const size_t T = fk_data.size(1);
+    const size_t width = static_cast<size_t>(x_end - x_begin);
+    const size_t tile_rows = static_cast<size_t>(i_end - i_begin);
+    const int x_max = waves_data[0].size(2);
+    thread_local std::vector<Scalar> scratch;
+    if (scratch.size() < tile_rows * n_basis * T * width) {
+        scratch.resize(tile_rows * n_basis * T * width);
+    }
+    const size_t x_stride = fk_data.stride(3);
+    Scalar* dst = scratch.data();
+    for (int i = i_begin; i < i_end; i++) {
+        for (size_t b = 0; b < n_basis; b++) {
+            for (size_t t = 0; t < T; t++, dst += width) {
+                const Scalar* src = &fk_data(b, t, i, x_begin);
+                for (size_t x = 0; x < width; x++) dst[x] = src[x * x_stride];
+            }
+        }
+    }
+    Field4D<Scalar> packed(scratch.data(), { n_basis, T, tile_rows, width },
+        { T * width, width, n_basis * T * width, 1 }, nullptr);
+
+    const size_t record_size = factor_record_size(static_cast<int>(n_basis), static_cast<int>(T));
+    for (int i = i_begin; i < i_end; i++) {
+        double* factor_out = factor_records.empty() ? nullptr
+            : factor_records.data() + static_cast<size_t>(i) * x_max * record_size;
+        solve_tile<Scalar>(i, x_begin, x_end, waves_data, packed, i - i_begin, x_begin, support, orto_kernel, options, factor_out, rows[i]);
+    }
+}
+
+// Решение плитки [x_begin, x_end) строки i по разложениям из кэша: basis-данные не нужны,
+// только проекции сигналов
+template <typename Scalar>
+static void solve_tile_cached(int i, int x_begin, int x_end, int n_basis,
+    const std::vector<Field3D<Scalar>>& waves_data,
+    const FactorCacheReader& cache,
+    RowResult& row_data) {
+    int n_waves = waves_data.size();
+    int T = waves_data[0].size(0);
+    thread_local OrtoWorkspace workspace;
+    workspace.reserve_waves(n_basis, T, n_waves);
+    for (int x = x_begin; x < x_end; x++) {
+        const double* record = cache.record(i, x);
+        Eigen::Map<const Matrix> R(record, n_basis, n_basis);
+        Eigen::Map<const Vector> norms(record + n_basis * n_basis, n_basis);
+        Eigen::Map<const RowMatrix> e(record + n_basis * n_basis + n_basis, n_basis, T);
+        for (int w = 0; w < n_waves; w++) {
+            for (int t = 0; t < T; t++) {
+                workspace.waves(t, w) = waves_data[w](t, i, x);
+            }
+        }
+        // Базиса в памяти нет: RMSE по энергии проекций, при сокращении — по остатку x - e^T * a
+        orto_solve_multi(workspace.waves, e, R, norms, workspace);
+        for (int w = 0; w < n_waves; w++) {
+            CoefficientData pixelData;
+            pixelData.coefs = workspace.coefs_multi.col(w);
+            pixelData.aprox_error = workspace.rmse_multi[w];
+            row_data[w][x] = std::move(pixelData);
+        }
+    }
+}
+
+// Отклонение результатов во float от расчёта в double
+struct PrecisionDeviation {
+    double max_coef = 0;      // максимальное отклонение коэффициента
+    double max_abs_coef = 0;  // максимальный по модулю коэффициент (для относительной оценки)
+    double max_error = 0;     // максимальное отклонение RMSE
+    size_t pixels = 0;
+
+    void add(const std::vector<CoefficientData>& row, const std::vector<CoefficientData>& reference) {
+        for (size_t x = 0; x < std::min(row.size(), reference.size()); x++) {
+            max_coef = std::max(max_coef, (row[x].coefs - reference[x].coefs).cwiseAbs().maxCoeff());
+            max_abs_coef = std::max(max_abs_coef, reference[x].coefs.cwiseAbs().maxCoeff());
+            max_error = std::max(max_error, std::abs(row[x].aprox_error - reference[x].aprox_error));
+            pixels++;
+        }
+    }
+};
+
+// Область расчёта: заданная в options (пространственная часть пуста — по умолчанию из zones.json,
+// с временным окном из options); при разбиении на части — только строки части options.shard_index
+static RegionOfInterest effective_region(const AreaConfigurationInfo& area_config, const StatisticsOptions& options) {
+    RegionOfInterest region = options.region.empty() ? area_config.default_region().with_time_of(options.region) : options.region;
+    if (options.shard_count > 1) {
+        region = region.shard(options.shard_index, options.shard_count);
+    }
+    return region;
+}
+
+// Счётчики пула за запуск (разность снимков): суммарно и по потокам (занят/ждал, с)
+static void print_pool_stats(const std::vector<ThreadPool::WorkerStats>& before, const std::vector<ThreadPool::WorkerStats>& after) {
+    double busy = 0, idle = 0;
+    size_t tasks = 0, steals = 0;
+    std::ostringstream per_worker;
+    for (size_t w = 0; w < after.size() && w < before.size(); w++) {
+        double worker_busy = after[w].busy_seconds - before[w].busy_seconds;
+        double worker_idle = after[w].idle_seconds - before[w].idle_seconds;
+        busy += worker_busy;
+        idle += worker_idle;
+        tasks += after[w].tasks - before[w].tasks;
+        steals += after[w].steals - before[w].steals;
+        per_worker << " " << worker_busy << "/" << worker_idle;
+    }
+    std::cout << "thread pool: " << after.size() << " workers, " << tasks << " tiles, " << steals << " stolen, busy "
+              << busy << " s, idle " << idle << " s (" << (busy + idle > 0 ? 100 * busy / (busy + idle) : 0) << "% busy)\n";
+    std::cout << "  busy/idle per worker, s:" << per_worker.str() << "\n";
+}
+
+// Загруженный y-пакет
+template <typename Scalar>
+struct LoadedBatch {
+    int y_start = 0;
+    int y_end = 0;
+    bool valid = false; // false — данных нет, пакет пропускается
+    std::vector<Field3D<Scalar>> waves_data;
+    Field4D<Scalar> fk_data;  // после чтения — в порядке файлов, после перестановки — в options.basis_layout
+    BasisSupport support;     // считается при перестановке
+    // Кэш разложений: открыт при попадании (тогда fk_data не читается)
+    FactorCacheKey cache_key;
+    std::string cache_path;
+    std::unique_ptr<FactorCacheReader> cache;
+    // Контроль точности для Float32: первая строка пакета в double
+    std::vector<Field3D<double>> wave_row;
+    Field4D<double> fk_row;
+    BasisSupport support_row;
+    // Пакет из контрольной точки прежнего запуска: строки уже посчитаны, данные не читаются
+    bool restored = false;
+    std::vector<RowResult> restored_rows;
+    double load_seconds = 0;
+    double convert_seconds = 0;
+};
+
+// Решённый y-пакет: строки результата и записи кэша разложений, ждущие стадии записи
+struct SolvedBatch {
+    int y_start = 0;
+    int y_end = 0;
+    bool restored = false; // из контрольной точки — повторно не сохраняется
+    std::vector<RowResult> rows;
+    std::vector<double> factor_records; // пусто — кэш не пишется
+    FactorCacheKey cache_key;
+    std::string cache_path;
+};
+
+// Расчёт по всем y-пакетам с типом хранения данных Scalar. Пакеты проходят конвейер
+// чтение -> перестановка -> решение -> запись; готовые строки передаются sink по порядку.
+// stream_results — sink не хранит строки (для оценки памяти); checkpoint (если задан) — контрольные
+// точки пакетов: сохранённые пакеты берутся из них, решённые в них записываются; coverage (если
+// задан) — записанные и пропущенные пакеты
+template <typename Scalar>
+static void calculate_statistics_impl(const std::string& basis,
+    BasisManager& basis_manager,
+    std::vector<WaveManager>& wave_managers,
+    const AreaConfigurationInfo& area_config,
+    const StatisticsRowSink& sink,
+    bool stream_results,
+    CheckpointStore* checkpoint,
+    BatchCoverage* coverage,
+    ThreadPool& pool,
+    const StatisticsOptions& options) {
+    RegionOfInterest roi = effective_region(area_config, options);
+    std::cout << "region: x [" << roi.x0 << ", " << roi.x1 << ") step " << roi.x_stride
+              << ", y [" << roi.y0 << ", " << roi.y1 << ") step " << roi.y_stride;
+    if (!roi.full_time()) {
+        std::cout << ", t [" << roi.t0 << ", " << (roi.t1 == std::numeric_limits<int>::max() ? std::string("end") : std::to_string(roi.t1))
+                  << ") step " << roi.t_stride;
+    }
+    std::cout << "\n";
+    // basis читается в порядке файлов (каждый файл — подряд в свой срез); в раскладку
+    // options.basis_layout его переставляет отдельная стадия. Упакованный basis уже в раскладке PixelMajor
+    const bool transpose_basis = options.basis_layout != BasisLayout::FileOrder && !basis_manager.packed;
+    // Во float пакет по y вдвое выше при том же объёме памяти
+    int batch_size = 64*3*6/count_from_name(basis) * static_cast<int>(sizeof(double) / sizeof(Scalar));
+    // Область обрезается один раз — по пересечению размеров basis и всех файлов мариограмм — и эта
+    // область передаётся всем загрузчикам: иначе каждый файл обрезал бы окно (в том числе --time)
+    // по своим размерам, и длины рядов у basis и мариограмм разошлись бы
+    NcStorage shape_storage;
+    RegionOfInterest clipped_roi;
+    bool shape_known = basis_manager.inspect(shape_storage)
+        && clip_to_shape(roi, shape_storage.shape[0], shape_storage.shape[1], shape_storage.shape[2], clipped_roi);
+    const RegionOfInterest basis_roi = clipped_roi;
+    for (auto& wave_manager : wave_managers) {
+        NcStorage wave_storage;
+        RegionOfInterest wave_roi;
+        shape_known = shape_known && wave_manager.inspect(wave_storage)
+            && clip_to_shape(clipped_roi, wave_storage.shape[0], wave_storage.shape[1], wave_storage.shape[2], wave_roi);
+        if (shape_known) clipped_roi = wave_roi;
+    }
+    if (shape_known) {
+        if (clipped_roi.x1 != basis_roi.x1 || clipped_roi.y1 != basis_roi.y1 || clipped_roi.t1 != basis_roi.t1) {
+            std::cout << "region: clipped to marigram files: x1 " << clipped_roi.x1 << ", y1 " << clipped_roi.y1
+                      << ", t1 " << clipped_roi.t1 << "\n";
+        }
+        roi = clipped_roi;
+    }
+    // Оценка памяти по размерам обрезанной области; с бюджетом — высота пакета по ней
+    MemoryFootprint footprint;
+    bool footprint_known = shape_known;
+    if (footprint_known) {
+        MemoryModel model;
+        model.n_basis = basis_manager.files().size();
+        model.n_waves = wave_managers.size();
+        model.T = roi.duration();
+        model.width = roi.width();
+        model.height = roi.height();
+        model.element_size = sizeof(Scalar);
+        model.lanes = std::max(1, options.batch_lanes);
+        model.threads = pool.size();
+        model.tile_scratch = tile_scratch_bytes;
+        model.io_workers = basis_manager.io_workers();
+        model.queue_depth = options.queue_depth;
+        model.stream_results = stream_results;
+        model.transpose_basis = transpose_basis;
+        model.resident_waves = options.wave_cache != nullptr;
+        model.write_factor_cache = !options.factor_cache_dir.empty();
+        footprint = estimate_footprint(model);
+        if (options.memory_budget > 0) {
+            batch_size = rows_for_budget(footprint, options.memory_budget, roi.height());
+            if (footprint.bytes(1) > options.memory_budget) {
+                std::cerr << "Бюджет памяти меньше оценки для пакета в одну строку: "
+                          << footprint.bytes(1) / double(1 << 30) << " GiB" << std::endl;
+            }
+        }
+        std::cout << "memory: " << batch_size << " rows per batch, predicted peak "
+                  << footprint.bytes(batch_size) / double(1 << 30) << " GiB";
+        if (options.memory_budget > 0) {
+            std::cout << " (budget " << options.memory_budget / double(1 << 30) << " GiB)";
+        }
+        std::cout << "\n";
+    }
+    // Ядро, специализированное под число базисных функций из имени папки
+    OrtoKernel orto_kernel = select_orto_kernel(count_from_name(basis));
+    // Ширина плитки — целое число пакетов пикселей пакетного решателя
+    const int lanes = (options.solver == SolverKind::Orto && is_supported_batch_lanes(options.batch_lanes)) ? options.batch_lanes : 1;
+    std::vector<ThreadPool::WorkerStats> pool_before = pool.stats();
+    PrecisionDeviation deviation;
+    // Кэш разложений: отпечаток basis-файлов считается один раз за запуск
+    bool use_factor_cache = !options.factor_cache_dir.empty();
+    int n_basis_files = 0;
+    uint64_t basis_hash = 0;
+    if (use_factor_cache) {
+        n_basis_files = basis_manager.files().size();
+        basis_hash = basis_manager.fingerprint();
+        // Разложение зависит и от порога носителя
+        if (options.support_threshold > 0) {
+            basis_hash = fingerprint_bytes(basis_hash, &options.support_threshold, sizeof(options.support_threshold));
+        }
+        std::filesystem::create_directories(options.factor_cache_dir);
+    }
+
+    // Мариограммы всей области из общего кэша: пакеты берутся из них без чтения файлов
+    std::vector<std::shared_ptr<const Field3D<Scalar>>> resident_waves;
+    if (options.wave_cache) {
+        for (auto& wave_manager : wave_managers) {
+            resident_waves.push_back(options.wave_cache->region<Scalar>(wave_manager, roi));
+        }
+    }
+
+    // Счётчики стадий; чтение и перестановку ведёт один поток, решение и запись — по своему
+    std::vector<StageStats> stages(4);
+    StageStats& load_stage = stages[0];
+    StageStats& convert_stage = stages[1];
+    StageStats& solve_stage = stages[2];
+    StageStats& write_stage = stages[3];
+    load_stage.name = "load";
+    convert_stage.name = "convert";
+    solve_stage.name = "solve";
+    write_stage.name = "write";
+
+    // Стадия чтения — строк [y_start, y_end) области roi: сигналы, затем кэш разложений или basis-файлы.
+    // Все обращения к NetCDF идут только отсюда
+    auto load_batch = [&](int y_start, int y_end) {
+        LoadedBatch<Scalar> batch;
+        StageTimer timer(load_stage.busy_seconds);
+        auto load_begin = std::chrono::steady_clock::now();
+        batch.y_start = y_start;
+        batch.y_end = y_end;
+        RegionOfInterest region = roi.rows(y_start, y_end);
+        if (checkpoint && checkpoint->restore(y_start, y_end, batch.restored_rows)) {
+            std::cout << "checkpoint: y [" << y_start << ", " << y_end << ") restored\n";
+            batch.restored = true;
+            batch.valid = true;
+            load_stage.batches++;
+            load_stage.rows += region.height();
+            return batch;
+        }
+        for (size_t w = 0; w < wave_managers.size(); w++) {
+            batch.waves_data.push_back(options.wave_cache
+                ? wave_rows(resident_waves[w], (y_start - roi.y0) / roi.y_stride, region.height())
+                : wave_managers[w].load_mariogramm_by_region<Scalar>(region));
+        }
+        bool wave_missing = std::any_of(batch.waves_data.begin(), batch.waves_data.end(), [](const Field3D<Scalar>& w) { return w.empty(); });
+        if (!wave_missing) {
+            int region_height = batch.waves_data[0].size(1);
+            int T = batch.waves_data[0].size(0);
+            int x_count = batch.waves_data[0].size(2);
+            batch.cache_key = FactorCacheKey{ basis, y_start, y_end, T, n_basis_files, x_count, region_height,
+                roi.x0, roi.x_stride, roi.y_stride, roi.t0, roi.t_stride, static_cast<int>(sizeof(Scalar)), basis_hash };
+            if (use_factor_cache) {
+                batch.cache_path = factor_cache_path(options.factor_cache_dir, batch.cache_key);
+                batch.cache = std::make_unique<FactorCacheReader>();
+                if (!batch.cache->open(batch.cache_path, batch.cache_key)) {
+                    batch.cache.reset();
+                }
+            }
+            if (batch.cache) {
+                std::cout << "factor cache hit: " << batch.cache_path << "\n";
+                batch.valid = true;
+            } else {
+                batch.fk_data = basis_manager.get_fk_region<Scalar>(region);
+                batch.valid = !batch.fk_data.empty();
+            }
+            // Решатель индексирует все сигналы и basis по размерам первого сигнала
+            if (batch.valid && !batch_shapes_match(batch.waves_data, batch.fk_data)) {
+                std::cerr << "Пакет y [" << y_start << ", " << y_end << ") пропущен" << std::endl;
+                batch.valid = false;
+            }
+            // Контроль точности: первая строка пакета в double (первый сценарий); при попадании
+            // в кэш разложений пакет не читает файлы basis, поэтому контроль пропускается
+            if (batch.valid && !batch.cache && std::is_same<Scalar, float>::value && options.report_precision_deviation) {
+                RegionOfInterest first_row = roi.rows(y_start, y_start + 1);
+                batch.wave_row.push_back(wave_managers[0].load_mariogramm_by_region<double>(first_row));
+                batch.fk_row = basis_manager.get_fk_region<double>(first_row);
+                if (!batch_shapes_match(batch.wave_row, batch.fk_row) || batch.wave_row[0].size(2) != batch.waves_data[0].size(2)) {
+                    batch.wave_row.clear();
+                    batch.fk_row = Field4D<double>();
+                }
+            }
+        }
+        load_stage.batches++;
+        load_stage.rows += region.height();
+        batch.load_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - load_begin).count();
+        return batch;
+    };
+
+    // Стадия перестановки: basis — в раскладку решателя, носители базисных функций
+    auto convert_batch = [&](LoadedBatch<Scalar>& batch) {
+        StageTimer timer(convert_stage.busy_seconds);
+        auto convert_begin = std::chrono::steady_clock::now();
+        if (!batch.fk_data.empty()) {
+            if (transpose_basis) {
+                batch.fk_data = convert_layout(std::move(batch.fk_data), options.basis_layout);
+            }
+            batch.support = compute_basis_support(batch.fk_data, options.support_threshold);
+        }
+        if (!batch.fk_row.empty()) {
+            batch.support_row = compute_basis_support(batch.fk_row, options.support_threshold);
+        }
+        convert_stage.batches++;
+        convert_stage.rows += batch.waves_data.empty() || batch.waves_data[0].empty() ? 0 : batch.waves_data[0].size(1);
+        batch.convert_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - convert_begin).count();
+    };
+
+    // Стадия решения: плитки пакета решаются пулом; false — пакет пропущен (данных нет)
+    auto solve_batch = [&](LoadedBatch<Scalar>& batch, SolvedBatch& solved) {
+        if (!batch.valid) {
+            if (coverage) coverage->skipped.emplace_back(batch.y_start, batch.y_end);
+            return false;
+        }
+        solved.y_start = batch.y_start;
+        solved.y_end = batch.y_end;
+        if (batch.restored) {
+            solved.rows = std::move(batch.restored_rows);
+            solved.restored = true;
+            return true;
+        }
+        StageTimer timer(solve_stage.busy_seconds);
+        const std::vector<Field3D<Scalar>>& waves_data = batch.waves_data;
+        const Field4D<Scalar>& fk_data = batch.fk_data;
+        const BasisSupport& support = batch.support;
+        const FactorCacheReader* cache = batch.cache.get();
+        int region_height = waves_data[0].size(1);
+        int T = waves_data[0].size(0);
+        int x_max = waves_data[0].size(2);
+        std::cout << "batch y [" << batch.y_start << ", " << batch.y_end << "): load " << batch.load_seconds
+                  << " s, convert " << batch.convert_seconds << " s\n";
+
+        if (use_factor_cache && !cache) {
+            solved.factor_records.resize(static_cast<size_t>(region_height) * x_max * factor_record_size(fk_data.size(0), T));
+            solved.cache_key = batch.cache_key;
+            solved.cache_path = batch.cache_path;
+        }
+        std::vector<double>& factor_records = solved.factor_records;
+
+        // Плитки решаются пулом; каждая пишет в свои ячейки rows
+        std::vector<RowResult>& rows = solved.rows;
+        rows.assign(region_height, RowResult(wave_managers.size(), std::vector<CoefficientData>(x_max)));
+        TileShape tile = choose_tile_shape(options, lanes, cache ? n_basis_files : fk_data.size(0), T, sizeof(Scalar),
+            x_max, region_height, pool.size());
+        const int tiles_per_row = (x_max + tile.width - 1) / tile.width;
+        const int tile_row_count = (region_height + tile.rows - 1) / tile.rows;
+        std::cout << "tiles: " << tile.width << " x " << tile.rows << " pixels\n";
+        size_t allocations_before = workspace_allocation_count();
+
+        pool.parallel_for(static_cast<size_t>(tile_row_count) * tiles_per_row, [&](size_t index) {
+            int i_begin = static_cast<int>(index / tiles_per_row) * tile.rows;
+            int i_end = std::min(region_height, i_begin + tile.rows);
+            int x_begin = static_cast<int>(index % tiles_per_row) * tile.width;
+            int x_end = std::min(x_max, x_begin + tile.width);
+            if (cache) {
+                for (int i = i_begin; i < i_end; i++) {
+                    solve_tile_cached<Scalar>(i, x_begin, x_end, n_basis_files, waves_data, *cache, rows[i]);
                 }
-                return row_data;
-                }));
+                return;
+            }
+            solve_packed_tile<Scalar>(i_begin, i_end, x_begin, x_end, waves_data, fk_data, support, orto_kernel, options, factor_records, rows);
+        });
+        std::cout << "workspace allocations: " << workspace_allocation_count() - allocations_before
+                  << " (" << region_height << " rows x " << x_max << " pixels)\n";
+
+        // Контроль точности: первая строка пакета пересчитывается по данным в double
+        if (!rows.empty() && !batch.wave_row.empty() && !batch.wave_row[0].empty() && !batch.fk_row.empty()) {
+            deviation.add(rows[0][0], solve_row<double>(0, x_max, batch.wave_row, batch.fk_row, batch.support_row, orto_kernel, options)[0]);
+        }
+        solve_stage.batches++;
+        solve_stage.rows += region_height;
+        return true;
+    };
+
+    // Стадия записи: пакет — в контрольную точку (до передачи получателю, который может забрать
+    // строки), строки — получателю по порядку, разложения — в кэш
+    auto write_batch = [&](SolvedBatch& solved) {
+        StageTimer timer(write_stage.busy_seconds);
+        if (checkpoint && !solved.restored) {
+            checkpoint->save(solved.y_start, solved.y_end, solved.rows);
+        }
+        for (auto& row : solved.rows) {
+            sink(row);
+        }
+        if (coverage) coverage->written.emplace_back(solved.y_start, solved.y_end);
+        if (!solved.factor_records.empty() && write_factor_cache(solved.cache_path, solved.cache_key, solved.factor_records)) {
+            std::cout << "factor cache written: " << solved.cache_path << "\n";
+        }
+        write_stage.batches++;
+        write_stage.rows += solved.rows.size();
+    };
+
+    // Пакеты — до batch_size строк области, границы по возможности выровнены по блокам basis-файлов
+    NcStorage basis_storage;
+    BatchPlan plan = basis_manager.plan_batches(roi, batch_size, &basis_storage);
+    if (!options.wave_cache) {
+        for (auto& wave_manager : wave_managers) {
+            wave_manager.plan_chunk_cache(roi, batch_size);
+        }
+    }
+    print_batch_plan(basis_storage, plan, roi.y_stride);
+    const std::vector<std::pair<int, int>>& batches = plan.batches;
+
+    auto pipeline_begin = std::chrono::steady_clock::now();
+    std::vector<QueueStats> queue_stats;
+    if (options.queue_depth > 0) {
+        // Чтение с перестановкой, решение и запись — в своих потоках; решение — в этом (задачи пула
+        // раздаются отсюда). Перестановка идёт в потоке чтения над только что прочитанным пакетом, а
+        // за пакет поток берётся, только когда для него есть место в очереди к решению. Поэтому в
+        // памяти не больше queue_depth + 1 пакетов данных: при queue_depth = 1 чтение пакета k + 1
+        // идёт одновременно с решением пакета k, и только
+        BoundedQueue<LoadedBatch<Scalar>> prepared("load -> solve", options.queue_depth);
+        BoundedQueue<SolvedBatch> solved("solve -> write", options.queue_depth);
+        std::thread loader([&]() {
+            for (const auto& rows : batches) {
+                {
+                    StageTimer timer(load_stage.blocked_seconds);
+                    prepared.wait_for_space();
+                }
+                LoadedBatch<Scalar> batch = load_batch(rows.first, rows.second);
+                convert_batch(batch);
+                prepared.push(std::move(batch));
+            }
+            prepared.close();
+        });
+        std::thread writer([&]() {
+            SolvedBatch batch;
+            for (;;) {
+                bool more = false;
+                {
+                    StageTimer timer(write_stage.starved_seconds);
+                    more = solved.pop(batch);
+                }
+                if (!more) break;
+                write_batch(batch);
+            }
+        });
+        for (;;) {
+            LoadedBatch<Scalar> batch;
+            bool more = false;
+            {
+                StageTimer timer(solve_stage.starved_seconds);
+                more = prepared.pop(batch);
+            }
+            if (!more) break;
+            SolvedBatch result;
+            if (!solve_batch(batch, result)) continue;
+            // Данные пакета освобождаются до ожидания места в очереди записи
+            batch = LoadedBatch<Scalar>();
+            StageTimer timer(solve_stage.blocked_seconds);
+            solved.push(std::move(result));
+        }
+        solved.close();
+        loader.join();
+        writer.join();
+        queue_stats = { prepared.stats(), solved.stats() };
+    } else {
+        // Стадии по очереди: в памяти один пакет
+        for (const auto& rows : batches) {
+            LoadedBatch<Scalar> batch = load_batch(rows.first, rows.second);
+            convert_batch(batch);
+            SolvedBatch result;
+            if (solve_batch(batch, result)) {
+                batch = LoadedBatch<Scalar>();
+                write_batch(result);
+            }
         }
+    }
+    print_pipeline_stats(stages, queue_stats, std::chrono::duration<double>(std::chrono::steady_clock::now() - pipeline_begin).count());
+    if (options.queue_depth > 0) {
+        // Чтение, скрытое за решением: всё время чтения, кроме того, что решатель простоял без пакета
+        double io_seconds = load_stage.busy_seconds;
+        double waited_seconds = solve_stage.starved_seconds;
+        std::cout << "prefetch: I/O " << io_seconds << " s, waited " << waited_seconds
+                  << " s, hidden " << std::max(0.0, io_seconds - waited_seconds) << " s\n";
+    }
+
+    if (checkpoint) {
+        std::cout << "checkpoint: " << checkpoint->restored() << " batches restored, " << checkpoint->saved()
+                  << " saved -> " << checkpoint->manifest_path() << "\n";
+    }
+    std::cout << "netcdf opens: " << basis_manager.total_opens() << " basis files\n";
+    print_pool_stats(pool_before, pool.stats());
+    if (footprint_known) {
+        // Пик процесса за всё время работы: при нескольких basis — наибольший из запусков
+        int rows = 0;
+        for (const auto& batch : batches) rows = std::max(rows, (batch.second - batch.first + roi.y_stride - 1) / roi.y_stride);
+        std::cout << "memory: peak RSS " << peak_rss_bytes() / double(1 << 30) << " GiB, predicted "
+                  << footprint.bytes(rows) / double(1 << 30) << " GiB\n";
+    }
+    if (options.wave_cache) {
+        std::cout << "wave cache: " << options.wave_cache->loads() << " loaded, " << options.wave_cache->hits()
+                  << " reused, " << options.wave_cache->bytes() / double(1 << 20) << " MiB resident\n";
+    }
+    basis_manager.close();
+    for (auto& wave_manager : wave_managers) {
+        wave_manager.close();
+    }
+
+    if (std::is_same<Scalar, float>::value && options.report_precision_deviation) {
+        std::cout << "float32 vs float64 (" << basis << ", " << deviation.pixels << " pixels checked): "
+                  << "max coefficient deviation = " << deviation.max_coef
+                  << " (relative " << (deviation.max_abs_coef > 0 ? deviation.max_coef / deviation.max_abs_coef : 0) << ")"
+                  << ", max RMSE deviation = " << deviation.max_error << "\n";
+    }
+}
 
-        for (auto& future : futures) {
-            auto row_data = future.get();
-            if (!row_data.empty()) {
-                statistics_orto.push_back(row_data);
+// Расчёт для сценариев waves с передачей строк sink (см. calculate_statistics_impl);
+// false — не открыты контрольные точки
+static bool run_statistics(const std::string& root_folder,
+    const std::string& bath,
+    const std::vector<std::string>& waves,
+    const std::string& basis,
+    const AreaConfigurationInfo& area_config,
+    const StatisticsRowSink& sink,
+    bool stream_results,
+    BatchCoverage* coverage,
+    const StatisticsOptions& options) {
+    // Формирование путей
+    std::string basis_path = root_folder + "/" + bath + "/" + basis;
+    BasisManager basis_manager(basis_path, options.io_workers);
+    std::vector<WaveManager> wave_managers;
+    for (const auto& wave : waves) {
+        wave_managers.emplace_back(root_folder + "/" + bath + "/" + wave + ".nc");
+    }
+    // Упакованный basis вместо NetCDF-файлов (и мариограммы из него, если они туда записаны)
+    std::string packed_path;
+    if (!options.packed_basis_dir.empty()) {
+        packed_path = (std::filesystem::path(options.packed_basis_dir) / (basis + ".tsb")).string();
+        if (std::filesystem::exists(packed_path) && basis_manager.open_packed(packed_path)) {
+            for (auto& wave_manager : wave_managers) {
+                if (wave_manager.use_packed(basis_manager.packed)) {
+                    std::cout << "packed wave: " << wave_manager.nc_file << "\n";
+                }
             }
         }
     }
+    if (wave_managers.empty()) {
+        return true;
+    }
+
+    // Контрольные точки: расчёт назван, как файл результата; входы — отпечатки содержимого basis и wave
+    // (а для упакованного basis — и самого файла .tsb, из которого идут данные), область и параметры,
+    // от которых зависит результат
+    std::unique_ptr<CheckpointStore> checkpoint;
+    if (!options.checkpoint_dir.empty()) {
+        std::string job = basis + "_" + bath;
+        uint64_t input_hash = basis_manager.fingerprint();
+        if (basis_manager.packed) {
+            uint64_t packed_hash = fingerprint_file(packed_path);
+            input_hash = fingerprint_bytes(input_hash, &packed_hash, sizeof(packed_hash));
+        }
+        for (size_t w = 0; w < waves.size(); w++) {
+            job += "_" + waves[w];
+            uint64_t wave_hash = fingerprint_file(wave_managers[w].nc_file);
+            input_hash = fingerprint_bytes(input_hash, &wave_hash, sizeof(wave_hash));
+        }
+        if (options.shard_count > 1) {
+            job += ".shard-" + std::to_string(options.shard_index) + "-of-" + std::to_string(options.shard_count);
+        }
+        RegionOfInterest roi = effective_region(area_config, options);
+        const int params[] = { roi.x0, roi.x1, roi.x_stride, roi.y0, roi.y1, roi.y_stride, roi.t0, roi.t1, roi.t_stride,
+            static_cast<int>(options.solver), static_cast<int>(options.precision), options.explicit_residual ? 1 : 0 };
+        input_hash = fingerprint_bytes(input_hash, params, sizeof(params));
+        input_hash = fingerprint_bytes(input_hash, &options.support_threshold, sizeof(options.support_threshold));
+        checkpoint = std::make_unique<CheckpointStore>();
+        if (!checkpoint->open(options.checkpoint_dir, job, input_hash, options.resume)) {
+            return false;
+        }
+    }
+
+    // Пул из options переживает запуск; без него — пул на один расчёт по числу ядер
+    std::shared_ptr<ThreadPool> pool = options.thread_pool ? options.thread_pool : std::make_shared<ThreadPool>();
+    if (options.precision == Precision::Float32) {
+        calculate_statistics_impl<float>(basis, basis_manager, wave_managers, area_config, sink, stream_results, checkpoint.get(), coverage, *pool, options);
+    } else {
+        calculate_statistics_impl<double>(basis, basis_manager, wave_managers, area_config, sink, stream_results, checkpoint.get(), coverage, *pool, options);
+    }
+    return true;
 }
 
-////       CSV-
+bool stream_statistics(const std::string& root_folder,
+    const std::string& bath,
+    const std::vector<std::string>& waves,
+    const std::string& basis,
+    const AreaConfigurationInfo& area_config,
+    const StatisticsRowSink& sink,
+    const StatisticsOptions& options,
+    BatchCoverage* coverage) {
+    return run_statistics(root_folder, bath, waves, basis, area_config, sink, true, coverage, options);
+}
+
+void calculate_statistics(const std::string& root_folder,
+    const std::string& bath,
+    const std::vector<std::string>& waves,
+    const std::string& basis,
+    const AreaConfigurationInfo& area_config,
+    std::vector<CoeffMatrix>& statistics,
+    const StatisticsOptions& options) {
+    statistics.assign(waves.size(), CoeffMatrix());
+    run_statistics(root_folder, bath, waves, basis, area_config, [&statistics](std::vector<std::vector<CoefficientData>>& row) {
+        for (size_t w = 0; w < row.size(); w++) {
+            statistics[w].push_back(std::move(row[w]));
+        }
+    }, false, nullptr, options);
+}
+
+void calculate_statistics(const std::string& root_folder,
+    const std::string& bath,
+    const std::string& wave,
+    const std::string& basis,
+    const AreaConfigurationInfo& area_config,
+    CoeffMatrix& statistics_orto,
+    const StatisticsOptions& options) {
+    std::vector<CoeffMatrix> statistics;
+    calculate_statistics(root_folder, bath, std::vector<std::string>{ wave }, basis, area_config, statistics, options);
+    statistics_orto = std::move(statistics[0]);
+}
+
+void benchmark_tile_shapes(int n_basis, int T, int height, int width,
+    const std::vector<std::pair<int, int>>& shapes,
+    const StatisticsOptions& options) {
+    // Синтетический пакет: случайные basis и сигналы, носитель — весь ряд
+    std::mt19937 generator(12345);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    std::array<size_t, 4> shape = { static_cast<size_t>(n_basis), static_cast<size_t>(T), static_cast<size_t>(height), static_cast<size_t>(width) };
+    Field4D<double> fk_data(shape, basis_strides(shape, options.basis_layout));
+    for (size_t b = 0; b < shape[0]; b++)
+        for (size_t t = 0; t < shape[1]; t++)
+            for (size_t i = 0; i < shape[2]; i++)
+                for (size_t x = 0; x < shape[3]; x++) fk_data(b, t, i, x) = uniform(generator);
+    std::vector<Field3D<double>> waves_data(1, Field3D<double>({ shape[1], shape[2], shape[3] }));
+    for (size_t t = 0; t < shape[1]; t++)
+        for (size_t i = 0; i < shape[2]; i++)
+            for (size_t x = 0; x < shape[3]; x++) waves_data[0](t, i, x) = uniform(generator);
+    BasisSupport support = compute_basis_support(fk_data, 0.0);
+
+    std::shared_ptr<ThreadPool> pool = options.thread_pool ? options.thread_pool : std::make_shared<ThreadPool>();
+    OrtoKernel orto_kernel = select_orto_kernel(n_basis);
+    const int lanes = (options.solver == SolverKind::Orto && is_supported_batch_lanes(options.batch_lanes)) ? options.batch_lanes : 1;
+    std::vector<double> no_records;
+    std::cout << "tile benchmark: " << n_basis << " basis x " << T << " samples, " << height << " x " << width
+              << " pixels, " << pool->size() << " threads, lanes " << lanes << "\n";
+
+    for (const auto& requested : shapes) {
+        StatisticsOptions tile_options = options;
+        tile_options.tile_width = requested.first;
+        tile_options.tile_rows = requested.second;
+        TileShape tile = choose_tile_shape(tile_options, lanes, shape[0], shape[1], sizeof(double), width, height, pool->size());
+        const int tiles_per_row = (width + tile.width - 1) / tile.width;
+        const int tile_row_count = (height + tile.rows - 1) / tile.rows;
+        // Лучший из трёх проходов (первый заодно прогревает рабочую память потоков)
+        double best = 0;
+        for (int repeat = 0; repeat < 3; repeat++) {
+            std::vector<RowResult> rows(height, RowResult(1, std::vector<CoefficientData>(width)));
+            auto begin = std::chrono::steady_clock::now();
+            pool->parallel_for(static_cast<size_t>(tile_row_count) * tiles_per_row, [&](size_t index) {
+                int i_begin = static_cast<int>(index / tiles_per_row) * tile.rows;
+                int x_begin = static_cast<int>(index % tiles_per_row) * tile.width;
+                solve_packed_tile<double>(i_begin, std::min(height, i_begin + tile.rows), x_begin, std::min(width, x_begin + tile.width),
+                    waves_data, fk_data, support, orto_kernel, tile_options, no_records, rows);
+            });
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            best = std::max(best, seconds > 0 ? height * static_cast<double>(width) / seconds : 0);
+        }
+        std::cout << "  tile " << tile.width << " x " << tile.rows << ": " << best << " pixels/s\n";
+    }
+}
+
+//// Функция сохранения двумерного массива коэффициентов в CSV-файл
 //void save_coefficients_csv(const std::string& filename, const CoeffMatrix& coeffs) {
 //    std::ofstream ofs(filename);
 //    if (!ofs.is_open()) {
-//        std::cerr << "    " << filename << "  .\n";
+//        std::cerr << "Не удалось открыть файл " << filename << " для записи.\n";
 //        return;
 //    }
-//    //      ,      (  )
+//    // Каждая строка – один ряд статистики, каждая ячейка содержит вектор коэффициентов (числа разделены пробелами)
 //    for (const auto& row : coeffs) {
 //        bool firstCell = true;
 //        for (const auto& vec : row) {
@@ -142,45 +1001,368 @@ void calculate_statistics(const std::string& root_folder,
 //        ofs << "\n";
 //    }
 //    ofs.close();
-//    std::cout << ": " << filename << "\n";
+//    std::cout << "Сохранено: " << filename << "\n";
 //}
 
+// Запись файла коэффициентов по строкам, не собирая его в памяти: объект {"[i,j]": {"aprox_error": ...,
+// "coefs": [...]}} с отступами, как у json::dump(4), и тем же текстом каждой записи. Текст файла
+// целиком не совпадает с json::dump(4): ключи идут по порядку строк и столбцов, а json сортирует их
+// как строки ("[10,0]" раньше "[2,0]"), чего при записи по строкам не сделать. Для читателя JSON это
+// тот же объект
+class CoefficientsJsonWriter {
+public:
+    bool open(const std::string& filename) {
+        filename_ = filename;
+        ofs_.open(filename);
+        if (!ofs_.is_open()) {
+            std::cerr << "Не удалось открыть файл " << filename << " для записи.\n";
+            return false;
+        }
+        ofs_ << "{";
+        return true;
+    }
+
+    void write_row(const std::vector<CoefficientData>& row) {
+        for (size_t col = 0; col < row.size(); ++col) {
+            // Преобразование Eigen::VectorXd в std::vector<double>
+            std::vector<double> vec(row[col].coefs.data(), row[col].coefs.data() + row[col].coefs.size());
+            nlohmann::json value = { {"coefs", vec}, {"aprox_error", row[col].aprox_error} };
+            // Значение — на уровень вложенности глубже: отступ после каждого перевода строки
+            std::string text = value.dump(4);
+            for (size_t pos = text.find('\n'); pos != std::string::npos; pos = text.find('\n', pos + 5)) {
+                text.insert(pos + 1, "    ");
+            }
+            ofs_ << (rows_ == 0 && col == 0 ? "\n" : ",\n") << "    \"[" << rows_ << "," << col << "]\": " << text;
+        }
+        columns_ = row.size();
+        rows_++;
+    }
+
+    // Удалить недописанный файл
+    void discard() {
+        ofs_.close();
+        std::error_code ec;
+        std::filesystem::remove(filename_, ec);
+    }
+
+    void close() {
+        ofs_ << (rows_ > 0 && columns_ > 0 ? "\n}" : "}");
+        ofs_.close();
+        std::cout << "Сохранено: " << filename_ << "\n";
+    }
+
+    size_t rows() const { return rows_; }
+    size_t columns() const { return columns_; }
+
+private:
+    std::string filename_;
+    std::ofstream ofs_;
+    size_t rows_ = 0;
+    size_t columns_ = 0;
+};
+
 void save_coefficients_json(const std::string& filename, const CoeffMatrix& coeffs) {
+    CoefficientsJsonWriter writer;
+    if (!writer.open(filename)) return;
+    for (const auto& row : coeffs) {
+        writer.write_row(row);
+    }
+    writer.close();
+}
+
+// Параметры расчёта рядом с файлом коэффициентов: область (с временным окном и шагами), метод,
+// тип хранения, число строк и столбцов результата, записанные и пропущенные y-пакеты и номер части.
+// Ключи "[i,j]" файла коэффициентов отсчитываются от начала области (у части — от её первой строки)
+static void save_statistics_metadata(const std::string& filename,
+    const std::string& bath,
+    const std::string& wave,
+    const std::string& basis,
+    const RegionOfInterest& region,
+    size_t rows,
+    size_t columns,
+    const BatchCoverage& coverage,
+    const StatisticsOptions& options) {
     nlohmann::json j;
-    for (size_t row = 0; row < coeffs.size(); ++row) {
-        for (size_t col = 0; col < coeffs[row].size(); ++col) {
-            std::string key = "[" + std::to_string(row) + "," + std::to_string(col) + "]";
-            //  Eigen::VectorXd  std::vector<double>
-            std::vector<double> vec(coeffs[row][col].coefs.data(),
-                coeffs[row][col].coefs.data() + coeffs[row][col].coefs.size());
-            double error = coeffs[row][col].aprox_error;
-            j[key] = { {"coefs", vec}, {"aprox_error", error} };
-        }
+    j["bath"] = bath;
+    j["wave"] = wave;
+    j["basis"] = basis;
+    j["region"] = {
+        {"x", {region.x0, region.x1, region.x_stride}},
+        {"y", {region.y0, region.y1, region.y_stride}},
+        // конец окна null — до конца записи
+        {"t", {region.t0, region.t1 == std::numeric_limits<int>::max() ? nlohmann::json() : nlohmann::json(region.t1), region.t_stride}}
+    };
+    j["solver"] = options.solver == SolverKind::Gram ? "gram" : "orto";
+    j["precision"] = options.precision == Precision::Float32 ? "float32" : "float64";
+    j["support_threshold"] = options.support_threshold;
+    j["rows"] = rows;
+    j["columns"] = columns;
+    j["batches"] = { {"written", json::array()}, {"skipped", json::array()} };
+    for (const auto& batch : coverage.written) j["batches"]["written"].push_back({ batch.first, batch.second });
+    for (const auto& batch : coverage.skipped) j["batches"]["skipped"].push_back({ batch.first, batch.second });
+    if (options.shard_count > 1) {
+        j["shard"] = { {"index", options.shard_index}, {"count", options.shard_count} };
     }
     std::ofstream ofs(filename);
     if (!ofs.is_open()) {
-        std::cerr << "    " << filename << "  .\n";
+        std::cerr << "Не удалось открыть файл " << filename << " для записи.\n";
         return;
     }
     ofs << j.dump(4);
-    ofs.close();
-    std::cout << ": " << filename << "\n";
 }
 
-//  save_and_plot_statistics:       CSV
+// Функция save_and_plot_statistics: вычисляет статистику и сохраняет коэффициенты в JSON
+// (для нескольких сценариев — по файлу на каждый, с именем сценария в имени файла).
+// Файлы пишутся по мере решения пакетов, весь результат в памяти не хранится
+void save_and_plot_statistics(const std::string& root_folder,
+    const std::string& bath,
+    const std::vector<std::string>& waves,
+    const std::string& basis,
+    const AreaConfigurationInfo& area_config,
+    const StatisticsOptions& options) {
+    std::vector<std::string> stems;
+    std::vector<CoefficientsJsonWriter> writers(waves.size());
+    for (size_t w = 0; w < waves.size(); w++) {
+        std::string filename_orto = (waves.size() == 1)
+            ? "case_statistics_hd_y_" + basis + bath + "_o"
+            : "case_statistics_hd_y_" + basis + bath + "_" + waves[w] + "_o";
+        // Часть расчёта — отдельный файл с номером части
+        if (options.shard_count > 1) {
+            filename_orto += ".shard-" + std::to_string(options.shard_index) + "-of-" + std::to_string(options.shard_count);
+        }
+        // Файлы открываются до расчёта: ошибка записи видна сразу, а не после всех пакетов
+        if (!writers[w].open(filename_orto + ".json")) return;
+        stems.push_back(filename_orto);
+    }
+
+    BatchCoverage coverage;
+    bool done = stream_statistics(root_folder, bath, waves, basis, area_config, [&writers](std::vector<std::vector<CoefficientData>>& row) {
+        for (size_t w = 0; w < row.size(); w++) {
+            writers[w].write_row(row[w]);
+        }
+    }, options, &coverage);
+    if (!coverage.skipped.empty()) {
+        std::cerr << "Пропущено пакетов без данных: " << coverage.skipped.size() << ", их строк в результате нет" << std::endl;
+    }
+
+    for (size_t w = 0; w < waves.size(); w++) {
+        // Расчёт не начат: пустые файлы результата не оставляются
+        if (!done) {
+            writers[w].discard();
+            continue;
+        }
+        writers[w].close();
+        save_statistics_metadata(stems[w] + ".meta.json", bath, waves[w], basis, effective_region(area_config, options),
+            writers[w].rows(), writers[w].columns(), coverage, options);
+    }
+}
+
 void save_and_plot_statistics(const std::string& root_folder,
     const std::string& bath,
     const std::string& wave,
     const std::string& basis,
-    const AreaConfigurationInfo& area_config) {
-    CoeffMatrix statistics_orto;
-    calculate_statistics(root_folder, bath, wave, basis, area_config, statistics_orto);
+    const AreaConfigurationInfo& area_config,
+    const StatisticsOptions& options) {
+    save_and_plot_statistics(root_folder, bath, std::vector<std::string>{ wave }, basis, area_config, options);
+}
+
+// Часть расчёта при сборке: файл, его параметры и строки
+struct StatisticsShard {
+    std::string file;
+    json meta;
+    json data;
+    int index = 0;
+    int rows = 0;
+    int columns = 0;
+};
 
-    std::string filename_orto = "case_statistics_hd_y_" + basis + bath + "_o.json";
-    //std::string filename_non_orto = "case_statistics_hd_y_" + basis + "_no.csv";
+// Параметры части записаны полностью (save_statistics_metadata при --shard): номер части, область,
+// строки, столбцы и пакеты. Без них собрать части нельзя
+static bool valid_shard_meta(const json& meta) {
+    auto int_array = [](const json& value, size_t size) {
+        return value.is_array() && value.size() == size
+            && std::all_of(value.begin(), value.end(), [](const json& v) { return v.is_number_integer(); });
+    };
+    auto ranges = [&int_array](const json& value) {
+        return value.is_array() && std::all_of(value.begin(), value.end(), [&int_array](const json& v) { return int_array(v, 2); });
+    };
+    auto member = [](const json& object, const char* key) -> const json* {
+        auto it = object.find(key);
+        return it != object.end() ? &*it : nullptr;
+    };
+    if (!meta.is_object()) return false;
+    const json* shard = member(meta, "shard");
+    const json* region = member(meta, "region");
+    const json* batches = member(meta, "batches");
+    const json* rows = member(meta, "rows");
+    const json* columns = member(meta, "columns");
+    if (!shard || !shard->is_object() || !region || !region->is_object() || !batches || !batches->is_object()
+        || !rows || !rows->is_number_integer() || !columns || !columns->is_number_integer()) return false;
+    const json* index = member(*shard, "index");
+    const json* count = member(*shard, "count");
+    if (!index || !index->is_number_integer() || !count || !count->is_number_integer() || count->get<int>() < 1) return false;
+    const json* x = member(*region, "x");
+    const json* y = member(*region, "y");
+    const json* t = member(*region, "t");
+    if (!x || !int_array(*x, 3) || !y || !int_array(*y, 3) || (*y)[2].get<int>() < 1 || !t || !t->is_array()) return false;
+    const json* written = member(*batches, "written");
+    const json* skipped = member(*batches, "skipped");
+    return written && ranges(*written) && skipped && ranges(*skipped);
+}
+
+// Поле key параметров расчёта (null, если его нет)
+static json meta_field(const json& meta, const char* key) {
+    auto it = meta.find(key);
+    return it != meta.end() ? *it : json();
+}
+
+bool merge_statistics_shards(const std::string& output, const std::vector<std::string>& files) {
+    // Файлы параметров (*.meta.json) пропускаются: маска вида *.shard-*.json захватывает и их
+    std::vector<std::string> parts;
+    for (const auto& file : files) {
+        const std::string meta_suffix = ".meta.json";
+        if (file.size() < meta_suffix.size() || file.compare(file.size() - meta_suffix.size(), meta_suffix.size(), meta_suffix) != 0) {
+            parts.push_back(file);
+        }
+    }
+    if (parts.empty()) {
+        std::cerr << "Не заданы части для сборки" << std::endl;
+        return false;
+    }
+    std::vector<StatisticsShard> shards;
+    for (const auto& file : parts) {
+        StatisticsShard shard;
+        shard.file = file;
+        std::string stem = file.size() > 5 && file.compare(file.size() - 5, 5, ".json") == 0 ? file.substr(0, file.size() - 5) : file;
+        std::ifstream meta_stream(stem + ".meta.json");
+        std::ifstream data_stream(file);
+        if (!meta_stream.is_open() || !data_stream.is_open()) {
+            std::cerr << "Не удалось открыть часть " << file << " или её " << stem << ".meta.json" << std::endl;
+            return false;
+        }
+        shard.meta = json::parse(meta_stream, nullptr, false);
+        shard.data = json::parse(data_stream, nullptr, false);
+        if (shard.meta.is_discarded() || shard.data.is_discarded() || !valid_shard_meta(shard.meta)) {
+            std::cerr << "Файл " << file << " не является частью расчёта (--shard) или её параметры неполны" << std::endl;
+            return false;
+        }
+        shard.index = shard.meta.at("shard").at("index").get<int>();
+        shard.rows = shard.meta.at("rows").get<int>();
+        shard.columns = shard.meta.at("columns").get<int>();
+        shards.push_back(std::move(shard));
+    }
+    std::sort(shards.begin(), shards.end(), [](const StatisticsShard& a, const StatisticsShard& b) { return a.index < b.index; });
+
+    // Все части одного расчёта: те же параметры, кроме строк области
+    const json& first = shards[0].meta;
+    const int count = first.at("shard").at("count").get<int>();
+    if (static_cast<int>(shards.size()) != count) {
+        std::cerr << "Частей " << shards.size() << ", ожидалось " << count << std::endl;
+        return false;
+    }
+    const char* same_keys[] = { "bath", "wave", "basis", "solver", "precision", "support_threshold" };
+    for (size_t k = 0; k < shards.size(); k++) {
+        const json& meta = shards[k].meta;
+        if (shards[k].index != static_cast<int>(k) || meta.at("shard").at("count").get<int>() != count) {
+            std::cerr << "Нет части " << k << " из " << count << " (или она задана дважды)" << std::endl;
+            return false;
+        }
+        const json& region = meta.at("region");
+        bool same = region.at("x") == first.at("region").at("x") && region.at("t") == first.at("region").at("t")
+            && region.at("y")[2] == first.at("region").at("y")[2];
+        for (const char* key : same_keys) same = same && meta_field(meta, key) == meta_field(first, key);
+        if (!same) {
+            std::cerr << "Часть " << shards[k].file << " посчитана с другими параметрами" << std::endl;
+            return false;
+        }
+    }
 
-    save_coefficients_json(filename_orto, statistics_orto);
-    /*save_coefficients_json(filename_non_orto, statistics_non_orto);*/
+    // Покрытие: части идут по y подряд; неполной (обрезанной по размеру файла) может быть только
+    // последняя непустая часть, после неё все части пусты. Внутри части пакеты записаны подряд от её
+    // начала без пропусков: пропущенный пакет сдвинул бы все следующие строки
+    const int y_stride = first.at("region").at("y")[2];
+    const int y_begin = first.at("region").at("y")[0];
+    json written = json::array();
+    int columns = -1;
+    int total_rows = 0;
+    bool clipped = false;
+    for (size_t k = 0; k < shards.size(); k++) {
+        const StatisticsShard& shard = shards[k];
+        const int y0 = shard.meta.at("region").at("y")[0];
+        const int y1 = shard.meta.at("region").at("y")[1];
+        const int height = (y1 - y0 + y_stride - 1) / y_stride;
+        const json& batches = shard.meta.at("batches");
+        bool covered = batches.at("skipped").empty();
+        int next_y = y0, batch_rows = 0;
+        for (const auto& batch : batches.at("written")) {
+            const int b0 = batch[0], b1 = batch[1];
+            covered = covered && b0 == next_y && b1 > b0 && b1 <= y1;
+            batch_rows += (b1 - b0 + y_stride - 1) / y_stride;
+            next_y = b1;
+            written.push_back(batch);
+        }
+        if (!covered || batch_rows != shard.rows) {
+            std::cerr << "В части " << shard.file << " пропущены строки: её пакеты не покрывают строки подряд" << std::endl;
+            return false;
+        }
+        bool gap = k > 0 && y0 != shards[k - 1].meta.at("region").at("y")[1].get<int>();
+        if (gap || shard.rows > height || (clipped && shard.rows > 0)
+            || (shard.rows > 0 && (y0 - y_begin) / y_stride != total_rows)) {
+            std::cerr << "Строки части " << shard.file << " не продолжают предыдущие части" << std::endl;
+            return false;
+        }
+        if (shard.rows < height) clipped = true;
+        if (shard.rows == 0) continue;
+        if (columns >= 0 && shard.columns != columns) {
+            std::cerr << "Число столбцов части " << shard.file << " отличается от остальных" << std::endl;
+            return false;
+        }
+        columns = shard.columns;
+        total_rows += shard.rows;
+    }
+
+    // Сборка: ключи "[i,j]" части сдвигаются на число строк перед ней
+    json merged = json::object();
+    int offset = 0;
+    for (const auto& shard : shards) {
+        size_t pixels = 0;
+        if (shard.data.is_object()) {
+            for (auto it = shard.data.begin(); it != shard.data.end(); ++it) {
+                int row = -1, col = -1;
+                if (std::sscanf(it.key().c_str(), "[%d,%d]", &row, &col) != 2 || row < 0 || row >= shard.rows || col < 0 || col >= shard.columns) {
+                    std::cerr << "Неверный ключ " << it.key() << " в " << shard.file << std::endl;
+                    return false;
+                }
+                merged["[" + std::to_string(row + offset) + "," + std::to_string(col) + "]"] = it.value();
+                pixels++;
+            }
+        }
+        if (pixels != static_cast<size_t>(shard.rows) * shard.columns) {
+            std::cerr << "В части " << shard.file << " " << pixels << " пикселей, ожидалось "
+                      << static_cast<size_t>(shard.rows) * shard.columns << std::endl;
+            return false;
+        }
+        offset += shard.rows;
+    }
+
+    std::ofstream ofs(output);
+    if (!ofs.is_open()) {
+        std::cerr << "Не удалось открыть файл " << output << " для записи.\n";
+        return false;
+    }
+    ofs << merged.dump(4);
+    ofs.close();
 
-    //         Excel    Python   .
+    // Параметры целого расчёта: область — от первой до последней части
+    json meta = first;
+    meta.erase("shard");
+    meta["region"]["y"][1] = shards.back().meta.at("region").at("y")[1];
+    meta["batches"] = { {"written", written}, {"skipped", json::array()} };
+    meta["rows"] = total_rows;
+    meta["columns"] = std::max(columns, 0);
+    std::string stem = output.size() > 5 && output.compare(output.size() - 5, 5, ".json") == 0 ? output.substr(0, output.size() - 5) : output;
+    std::ofstream meta_stream(stem + ".meta.json");
+    meta_stream << meta.dump(4);
+    std::cout << "merged " << count << " shards: " << total_rows << " rows x " << std::max(columns, 0) << " columns -> " << output << "\n";
+    return true;
 }
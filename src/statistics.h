@@ -2,34 +2,169 @@
 #ifndef STATISTICS_H
 #define STATISTICS_H
 
+#include <functional>
 #include <string>
 #include <vector>
+#include <utility>
 #include <Eigen/Dense>
 #include "stable_data_structs.h"
 #include "managers.h"
+#include "wave_cache.h"
+#include "thread_pool.h"
 
-//        
+// Новая структура для хранения коэффициентов и ошибки аппроксимации
 struct CoefficientData {
     Eigen::VectorXd coefs;
     double aprox_error;
 };
 
-//       :    CoefficientData
+// Тип для хранения данных по всем пикселям: двумерный массив объектов CoefficientData
 using CoeffMatrix = std::vector<std::vector<CoefficientData>>;
 
-//        
+// Метод решения задачи аппроксимации для каждого пикселя
+enum class SolverKind {
+    Orto, // ортогонализация Грама-Шмидта (approximate_with_non_orthogonal_basis_orto)
+    Gram  // матрица Грама и разложение Холецкого (approximate_with_non_orthogonal_basis_gram)
+};
+
+// Тип хранения данных wave и basis (накопление и решение всегда в double)
+enum class Precision {
+    Float64,
+    Float32 // вдвое меньше памяти и вдвое больше пикселей в пакете
+};
+
+// Параметры расчёта статистики
+struct StatisticsOptions {
+    SolverKind solver = SolverKind::Orto;
+    // Число соседних пикселей, решаемых пакетом (4, 8 или 16; 0 — по одному пикселю).
+    // Используется только с SolverKind::Orto
+    int batch_lanes = 0;
+    Precision precision = Precision::Float64;
+    // Для Float32: пересчитывать первую строку каждого пакета в double и выводить
+    // максимальное отклонение коэффициентов и RMSE (пакеты из кэша разложений не проверяются)
+    bool report_precision_deviation = false;
+    // Папка кэша разложений базиса по y-пакетам (factor_cache.h); пусто — кэш не используется.
+    // При попадании в кэш basis-файлы пакета не читаются
+    std::string factor_cache_dir;
+    // RMSE по явному остатку x - f_k^T * coefs вместо энергии проекций (для отладки;
+    // при попадании в кэш разложений не действует — исходного базиса в памяти нет)
+    bool explicit_residual = false;
+    // Порог носителя базисных мариограмм (basis_support.h): отсчёты с |f| <= порог * max|f|
+    // до прихода и после затухания волны считаются нулём и пропускаются ядрами.
+    // 0 — отбрасываются только точные нули и порядок ортогонализации остаётся исходным: результат
+    // отличается от расчёта без носителей только округлением при суммировании
+    double support_threshold = 0;
+    // Порядок хранения данных basis в памяти (managers.h): FileOrder читается без перестановки,
+    // PixelMajor даёт непрерывный блок n_basis x T на пиксель
+    BasisLayout basis_layout = BasisLayout::FileOrder;
+    // Область расчёта (x0, x1, y0, y1 и шаги); пустая — AreaConfigurationInfo::default_region().
+    // Из NetCDF-файлов читается только она
+    RegionOfInterest region;
+    // Папка упакованных basis (packed_basis.h, подкоманда convert): если в ней есть <basis>.tsb,
+    // basis читается из него через отображение в память, а не из NetCDF-файлов
+    std::string packed_basis_dir;
+    // Конвейер (pipeline.h): чтение с перестановкой basis в раскладку basis_layout, решение и запись
+    // пакетов идут одновременно в своих потоках, между ними — очереди из queue_depth пакетов.
+    // В памяти не больше queue_depth + 1 пакетов данных (1 — читается следующий, пока решается
+    // текущий); 0 — стадии по очереди в одном потоке (в памяти один пакет)
+    int queue_depth = 1;
+    // Общий кэш мариограмм (wave_cache.h) для задания из нескольких basis-папок: область расчёта
+    // каждого wave читается один раз и остаётся в памяти; nullptr — чтение по пакетам
+    std::shared_ptr<WaveFieldCache> wave_cache;
+    // Потоков чтения basis-файлов (managers.h); больше 1 ускоряет чтение только в сборке
+    // NETCDF_THREADSAFE, иначе вызовы NetCDF всё равно идут по одному
+    int io_workers = default_io_workers;
+    // Бюджет памяти (байт): высота y-пакета выбирается наибольшей, при которой оценка памяти
+    // (memory_budget.h) в него помещается; 0 — прежняя высота 64*3*6/n_basis строк
+    size_t memory_budget = 0;
+    // Пул потоков решения (thread_pool.h), общий для пакетов и запусков; nullptr — пул на один
+    // расчёт по числу аппаратных потоков
+    std::shared_ptr<ThreadPool> thread_pool;
+    // Форма плитки — единицы работы пула: пикселей по x и строк; 0 — ширина 8 (не меньше пакета
+    // пикселей batch_lanes), строк — сколько помещается в L2 вместе с упакованным блоком basis
+    int tile_width = 0;
+    int tile_rows = 0;
+    // Часть shard_index из shard_count: считаются только её строки области (RegionOfInterest::shard),
+    // результат — частичный файл с номером части (merge_statistics_shards собирает целый)
+    int shard_index = 0;
+    int shard_count = 1;
+    // Папка контрольных точек (checkpoint.h): каждый решённый y-пакет сохраняется вместе с манифестом;
+    // пусто — без контрольных точек
+    std::string checkpoint_dir;
+    // Продолжить прерванный расчёт: пакеты из манифеста в checkpoint_dir, посчитанные с теми же
+    // входами, не читаются и не решаются — их строки берутся из контрольных точек
+    bool resume = false;
+};
+
+// Функция для вычисления статистики аппроксимации по всему региону
 void calculate_statistics(const std::string& root_folder,
     const std::string& bath,
     const std::string& wave,
     const std::string& basis,
     const AreaConfigurationInfo& area_config,
-    CoeffMatrix& statistics_orto);
+    CoeffMatrix& statistics_orto,
+    const StatisticsOptions& options = StatisticsOptions());
+
+// То же для нескольких сценариев wave с одним базисом: базис каждого пикселя раскладывается
+// один раз, statistics[w] — результат для waves[w]
+void calculate_statistics(const std::string& root_folder,
+    const std::string& bath,
+    const std::vector<std::string>& waves,
+    const std::string& basis,
+    const AreaConfigurationInfo& area_config,
+    std::vector<CoeffMatrix>& statistics,
+    const StatisticsOptions& options = StatisticsOptions());
+
+// Получатель строк результата: row[w] — строка области для сценария waves[w] (пиксели по x).
+// Вызывается по порядку строк из стадии записи конвейера, пока следующие пакеты ещё читаются и решаются
+using StatisticsRowSink = std::function<void(std::vector<std::vector<CoefficientData>>& row)>;
+
+// Какие y-пакеты дошли до sink: строки [y_start, y_end) записанных пакетов по порядку и пакетов,
+// пропущенных без данных (их строк в результате нет, следующие строки сдвинуты)
+struct BatchCoverage {
+    std::vector<std::pair<int, int>> written;
+    std::vector<std::pair<int, int>> skipped;
+};
+
+// Потоковый расчёт: готовые строки передаются sink по мере решения пакетов, результат всей
+// области в памяти не копится; coverage (если задан) — записанные и пропущенные пакеты.
+// false — расчёт не начат (сообщение выводится в std::cerr)
+bool stream_statistics(const std::string& root_folder,
+    const std::string& bath,
+    const std::vector<std::string>& waves,
+    const std::string& basis,
+    const AreaConfigurationInfo& area_config,
+    const StatisticsRowSink& sink,
+    const StatisticsOptions& options = StatisticsOptions(),
+    BatchCoverage* coverage = nullptr);
+
+// Замер скорости решения (пикселей в секунду) плитками разной формы: shapes — пары
+// (tile_width, tile_rows), как в StatisticsOptions; синтетический пакет height x width пикселей
+// из n_basis случайных рядов длины T в раскладке options.basis_layout
+void benchmark_tile_shapes(int n_basis, int T, int height, int width,
+    const std::vector<std::pair<int, int>>& shapes,
+    const StatisticsOptions& options = StatisticsOptions());
+
+// Сборка частичных результатов (--shard) в один файл коэффициентов output. parts — файлы частей
+// одного расчёта (рядом с каждым — <part>.meta.json; сами *.meta.json в списке пропускаются); проверяется, что есть все части, параметры
+// расчёта совпадают, а строки частей покрывают область без пропусков и наложений.
+// false — ошибка (сообщение выводится в std::cerr)
+bool merge_statistics_shards(const std::string& output, const std::vector<std::string>& parts);
 
-//      JSON-
+// Функция для сохранения статистики в JSON-файл: строки пишутся по мере расчёта
 void save_and_plot_statistics(const std::string& root_folder,
     const std::string& bath,
     const std::string& wave,
     const std::string& basis,
-    const AreaConfigurationInfo& area_config);
+    const AreaConfigurationInfo& area_config,
+    const StatisticsOptions& options = StatisticsOptions());
+
+// То же для нескольких сценариев wave: по одному JSON-файлу на сценарий
+void save_and_plot_statistics(const std::string& root_folder,
+    const std::string& bath,
+    const std::vector<std::string>& waves,
+    const std::string& basis,
+    const AreaConfigurationInfo& area_config,
+    const StatisticsOptions& options = StatisticsOptions());
 
 #endif // STATISTICS_H
@@ -0,0 +1,162 @@
+#ifndef TENSOR_H
+#define TENSOR_H
+
+#include <array>
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Многомерный массив с одним непрерывным выделением памяти и явными шагами (в элементах).
+// Индексы всегда логические (например, [b][t][i][x] для basis), а физический порядок хранения
+// задаётся шагами, поэтому один и тот же код чтения работает с любой раскладкой.
+
+// Невладеющее представление части тензора
+template <typename Scalar, int Rank>
+struct TensorView {
+    Scalar* data = nullptr;
+    std::array<size_t, Rank> shape{};
+    std::array<size_t, Rank> strides{};
+
+    template <typename... Index>
+    Scalar& operator()(Index... index) const {
+        static_assert(sizeof...(Index) == Rank, "wrong number of indices");
+        const size_t idx[] = { static_cast<size_t>(index)... };
+        size_t offset = 0;
+        for (int d = 0; d < Rank; d++) offset += idx[d] * strides[d];
+        return data[offset];
+    }
+
+    size_t size(int d) const { return shape[d]; }
+    size_t stride(int d) const { return strides[d]; }
+
+    // Срез по первому измерению
+    TensorView<Scalar, Rank - 1> slice(size_t k) const {
+        static_assert(Rank > 1, "slice of a rank-1 view");
+        TensorView<Scalar, Rank - 1> view;
+        view.data = data + k * strides[0];
+        for (int d = 1; d < Rank; d++) {
+            view.shape[d - 1] = shape[d];
+            view.strides[d - 1] = strides[d];
+        }
+        return view;
+    }
+};
+
+// Тензор: владеет своей памятью или представляет чужую (например, отображённый в память файл)
+template <typename Scalar, int Rank>
+class Tensor {
+public:
+    Tensor() = default;
+
+    // Тензор заданной формы с заданными шагами; память под все элементы выделяется один раз
+    Tensor(const std::array<size_t, Rank>& shape, const std::array<size_t, Rank>& strides)
+        : shape_(shape), strides_(strides) {
+        size_t count = 1;
+        for (size_t extent : shape_) count *= extent;
+        storage_.assign(count, Scalar(0));
+        data_ = storage_.data();
+    }
+
+    // Тензор поверх чужой памяти без копирования; owner удерживает её, пока жив тензор.
+    // Память может быть только для чтения — такой тензор не изменяют (см. owns_data)
+    Tensor(Scalar* data, const std::array<size_t, Rank>& shape, const std::array<size_t, Rank>& strides,
+        std::shared_ptr<const void> owner)
+        : shape_(shape), strides_(strides), data_(data), owner_(std::move(owner)) {}
+
+    Tensor(const Tensor& other)
+        : shape_(other.shape_), strides_(other.strides_), storage_(other.storage_), owner_(other.owner_) {
+        data_ = other.owns_data() ? storage_.data() : other.data_;
+    }
+    Tensor& operator=(const Tensor& other) {
+        if (this != &other) *this = Tensor(other);
+        return *this;
+    }
+    // При перемещении вектор сохраняет буфер, поэтому data_ остаётся верным
+    Tensor(Tensor&& other) noexcept
+        : shape_(other.shape_), strides_(other.strides_), storage_(std::move(other.storage_)),
+          data_(other.data_), owner_(std::move(other.owner_)) {
+        other.data_ = nullptr;
+    }
+    Tensor& operator=(Tensor&& other) noexcept {
+        if (this != &other) {
+            shape_ = other.shape_;
+            strides_ = other.strides_;
+            storage_ = std::move(other.storage_);
+            data_ = other.data_;
+            owner_ = std::move(other.owner_);
+            other.data_ = nullptr;
+        }
+        return *this;
+    }
+
+    // Тензор с построчным (C) порядком: последний индекс меняется быстрее всех
+    explicit Tensor(const std::array<size_t, Rank>& shape)
+        : Tensor(shape, row_major_strides(shape)) {}
+
+    static std::array<size_t, Rank> row_major_strides(const std::array<size_t, Rank>& shape) {
+        std::array<size_t, Rank> strides{};
+        size_t step = 1;
+        for (int d = Rank - 1; d >= 0; d--) {
+            strides[d] = step;
+            step *= shape[d];
+        }
+        return strides;
+    }
+
+    template <typename... Index>
+    Scalar& operator()(Index... index) { return view()(index...); }
+    template <typename... Index>
+    const Scalar& operator()(Index... index) const { return view()(index...); }
+
+    bool empty() const { return data_ == nullptr; }
+    // false — представление чужой памяти
+    bool owns_data() const { return !storage_.empty(); }
+    size_t size(int d) const { return shape_[d]; }
+    size_t stride(int d) const { return strides_[d]; }
+    const std::array<size_t, Rank>& shape() const { return shape_; }
+    Scalar* data() { return data_; }
+    const Scalar* data() const { return data_; }
+
+    TensorView<Scalar, Rank> view() { return { data_, shape_, strides_ }; }
+    TensorView<const Scalar, Rank> view() const { return { data_, shape_, strides_ }; }
+    TensorView<Scalar, Rank - 1> slice(size_t k) { return view().slice(k); }
+    TensorView<const Scalar, Rank - 1> slice(size_t k) const { return view().slice(k); }
+
+    // Копия в собственной плотно упакованной памяти с тем же порядком измерений
+    // (измерение с большим шагом остаётся внешним)
+    Tensor compact_copy() const {
+        std::array<int, Rank> order;
+        for (int d = 0; d < Rank; d++) order[d] = d;
+        std::stable_sort(order.begin(), order.end(), [this](int a, int b) { return strides_[a] > strides_[b]; });
+        std::array<size_t, Rank> strides{};
+        size_t step = 1;
+        for (int k = Rank - 1; k >= 0; k--) {
+            strides[order[k]] = step;
+            step *= shape_[order[k]];
+        }
+        Tensor copy(shape_, strides);
+        if (copy.storage_.empty()) return copy;
+        // Перебор всех индексов (последнее измерение — быстрее всех)
+        std::array<size_t, Rank> index{};
+        for (size_t n = 0; n < copy.storage_.size(); n++) {
+            size_t from = 0, to = 0;
+            for (int d = 0; d < Rank; d++) {
+                from += index[d] * strides_[d];
+                to += index[d] * strides[d];
+            }
+            copy.data_[to] = data_[from];
+            for (int d = Rank - 1; d >= 0 && ++index[d] == shape_[d]; d--) index[d] = 0;
+        }
+        return copy;
+    }
+
+private:
+    std::array<size_t, Rank> shape_{};
+    std::array<size_t, Rank> strides_{};
+    std::vector<Scalar> storage_;
+    Scalar* data_ = nullptr;
+    std::shared_ptr<const void> owner_; // держит чужую память
+};
+
+#endif // TENSOR_H
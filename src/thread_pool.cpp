@@ -0,0 +1,113 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+
+static uint64_t elapsed_ns(std::chrono::steady_clock::time_point begin) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count());
+}
+
+ThreadPool::ThreadPool(int threads) {
+    if (threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (int k = 0; k < threads; k++) {
+        workers_.push_back(std::make_unique<Worker>());
+    }
+    for (int k = 0; k < threads; k++) {
+        threads_.emplace_back(&ThreadPool::run, this, k);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+bool ThreadPool::take(int index, std::function<void()>& task) {
+    const int n = static_cast<int>(workers_.size());
+    for (int k = 0; k < n; k++) {
+        Worker& worker = *workers_[(index + k) % n];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.queue.empty()) continue;
+        // Своя очередь — с начала (порядок раздачи), чужая — с конца (дальние от её владельца плитки)
+        if (k == 0) {
+            task = std::move(worker.queue.front());
+            worker.queue.pop_front();
+        } else {
+            task = std::move(worker.queue.back());
+            worker.queue.pop_back();
+            workers_[index]->steals++;
+        }
+        queued_--;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::run(int index) {
+    Worker& self = *workers_[index];
+    for (;;) {
+        std::function<void()> task;
+        if (take(index, task)) {
+            // Счётчик задач — до выполнения: parallel_for может вернуться сразу после последней задачи
+            self.tasks++;
+            auto begin = std::chrono::steady_clock::now();
+            task();
+            self.busy_ns += elapsed_ns(begin);
+            continue;
+        }
+        auto begin = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+        wake_.wait(lock, [this] { return stop_ || queued_ > 0; });
+        self.idle_ns += elapsed_ns(begin);
+        if (stop_ && queued_ == 0) return;
+    }
+}
+
+void ThreadPool::parallel_for(size_t count, const std::function<void(size_t)>& task) {
+    if (count == 0) return;
+    std::mutex done_mutex;
+    std::condition_variable done;
+    size_t remaining = count;
+
+    // Счётчик растёт до раздачи: поток, забравший задачу, сразу его уменьшает
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        queued_ += count;
+    }
+    const size_t n = workers_.size();
+    for (size_t w = 0; w < n; w++) {
+        size_t begin = count * w / n;
+        size_t end = count * (w + 1) / n;
+        if (begin == end) continue;
+        std::lock_guard<std::mutex> lock(workers_[w]->mutex);
+        for (size_t k = begin; k < end; k++) {
+            workers_[w]->queue.emplace_back([k, &task, &done_mutex, &done, &remaining]() {
+                task(k);
+                std::lock_guard<std::mutex> done_lock(done_mutex);
+                if (--remaining == 0) done.notify_one();
+            });
+        }
+    }
+    wake_.notify_all();
+
+    std::unique_lock<std::mutex> lock(done_mutex);
+    done.wait(lock, [&remaining] { return remaining == 0; });
+}
+
+std::vector<ThreadPool::WorkerStats> ThreadPool::stats() const {
+    std::vector<WorkerStats> result(workers_.size());
+    for (size_t w = 0; w < workers_.size(); w++) {
+        result[w].busy_seconds = workers_[w]->busy_ns * 1e-9;
+        result[w].idle_seconds = workers_[w]->idle_ns * 1e-9;
+        result[w].tasks = workers_[w]->tasks;
+        result[w].steals = workers_[w]->steals;
+    }
+    return result;
+}
@@ -0,0 +1,63 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Постоянный пул потоков с перехватом задач. У каждого потока своя очередь: parallel_for
+// раздаёт задачи потокам непрерывными блоками (соседние плитки — одному потоку), поток берёт
+// задачи из начала своей очереди, а опустев — забирает с конца чужой. Потоки создаются один раз
+// и переиспользуются между пакетами и запусками (вместе с их thread_local рабочей памятью)
+class ThreadPool {
+public:
+    // threads = 0 — по числу аппаратных потоков
+    explicit ThreadPool(int threads = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return static_cast<int>(threads_.size()); }
+
+    // Выполнить task(k) для всех k в [0, count) и дождаться завершения.
+    // Вызывать не из задач пула
+    void parallel_for(size_t count, const std::function<void(size_t)>& task);
+
+    // Счётчики потока за время жизни пула
+    struct WorkerStats {
+        double busy_seconds = 0; // выполнение задач
+        double idle_seconds = 0; // ожидание задач
+        size_t tasks = 0;
+        size_t steals = 0;       // задачи, забранные из чужих очередей
+    };
+    std::vector<WorkerStats> stats() const;
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> queue;
+        std::atomic<uint64_t> busy_ns{ 0 };
+        std::atomic<uint64_t> idle_ns{ 0 };
+        std::atomic<size_t> tasks{ 0 };
+        std::atomic<size_t> steals{ 0 };
+    };
+
+    void run(int index);
+    bool take(int index, std::function<void()>& task);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    std::atomic<size_t> queued_{ 0 }; // задач во всех очередях
+    bool stop_ = false;
+};
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,77 @@
+#include "wave_cache.h"
+#include "fingerprint.h"
+#include <algorithm>
+#include <iostream>
+
+static bool same_region(const RegionOfInterest& a, const RegionOfInterest& b) {
+    return a.x0 == b.x0 && a.x1 == b.x1 && a.x_stride == b.x_stride
+        && a.y0 == b.y0 && a.y1 == b.y1 && a.y_stride == b.y_stride
+        && a.t0 == b.t0 && a.t1 == b.t1 && a.t_stride == b.t_stride;
+}
+
+template <typename Scalar>
+std::shared_ptr<const Field3D<Scalar>> WaveFieldCache::region(WaveManager& wave_manager, const RegionOfInterest& roi) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t hash = fingerprint_file(wave_manager.nc_file);
+    auto it = std::find_if(entries_.begin(), entries_.end(), [&](const Entry& entry) {
+        return entry.file == wave_manager.nc_file && entry.element_size == sizeof(Scalar) && same_region(entry.roi, roi);
+    });
+    if (it != entries_.end()) {
+        if (it->hash == hash) {
+            hits_++;
+            return std::static_pointer_cast<const Field3D<Scalar>>(it->field);
+        }
+        entries_.erase(it);
+    }
+
+    auto field = std::make_shared<const Field3D<Scalar>>(wave_manager.load_mariogramm_by_region<Scalar>(roi));
+    if (field->empty()) return nullptr;
+    loads_++;
+    Entry entry;
+    entry.file = wave_manager.nc_file;
+    entry.roi = roi;
+    entry.element_size = sizeof(Scalar);
+    entry.hash = hash;
+    // Представление упакованного файла памяти не занимает, но удерживает отображение
+    entry.bytes = field->owns_data() ? field->size(0) * field->size(1) * field->size(2) * sizeof(Scalar) : 0;
+    entry.field = field;
+    entries_.push_back(std::move(entry));
+    return field;
+}
+
+size_t WaveFieldCache::bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t total = 0;
+    for (const auto& entry : entries_) total += entry.bytes;
+    return total;
+}
+
+size_t WaveFieldCache::loads() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return loads_;
+}
+
+size_t WaveFieldCache::hits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+}
+
+void WaveFieldCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+}
+
+template <typename Scalar>
+Field3D<Scalar> wave_rows(const std::shared_ptr<const Field3D<Scalar>>& field, int first, int count) {
+    if (!field || first < 0 || count <= 0 || static_cast<size_t>(first) >= field->size(1)) return Field3D<Scalar>();
+    size_t rows = std::min(static_cast<size_t>(count), field->size(1) - first);
+    // Данные не изменяются: расчёт только читает мариограммы
+    Scalar* data = const_cast<Scalar*>(field->data()) + static_cast<size_t>(first) * field->stride(1);
+    return Field3D<Scalar>(data, { field->size(0), rows, field->size(2) },
+        { field->stride(0), field->stride(1), field->stride(2) }, field);
+}
+
+template std::shared_ptr<const Field3D<double>> WaveFieldCache::region<double>(WaveManager&, const RegionOfInterest&);
+template std::shared_ptr<const Field3D<float>> WaveFieldCache::region<float>(WaveManager&, const RegionOfInterest&);
+template Field3D<double> wave_rows<double>(const std::shared_ptr<const Field3D<double>>&, int, int);
+template Field3D<float> wave_rows<float>(const std::shared_ptr<const Field3D<float>>&, int, int);
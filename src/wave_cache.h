@@ -0,0 +1,51 @@
+#ifndef WAVE_CACHE_H
+#define WAVE_CACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "managers.h"
+
+// Мариограммы, общие для запусков с разными базисами. Сигнал wave не зависит от базиса, поэтому
+// в задании из нескольких basis-папок область расчёта читается из файла один раз и остаётся в
+// памяти, а пакеты каждого запуска берутся из неё представлениями без копирования.
+// Запись находится по пути файла, области (с временным окном и шагами) и типу хранения и
+// сверяется по отпечатку файла: изменённый файл читается заново
+class WaveFieldCache {
+public:
+    // Мариограммы файла wave_manager.nc_file для всей области roi, (t, i, x) как
+    // WaveManager::load_mariogramm_by_region; при первом обращении читаются через wave_manager.
+    // nullptr — файл не прочитан (сообщение уже выведено)
+    template <typename Scalar>
+    std::shared_ptr<const Field3D<Scalar>> region(WaveManager& wave_manager, const RegionOfInterest& roi);
+
+    // Удерживаемый объём (байт), число чтений файлов и повторных использований
+    size_t bytes() const;
+    size_t loads() const;
+    size_t hits() const;
+    void clear();
+
+private:
+    struct Entry {
+        std::string file;
+        RegionOfInterest roi;
+        size_t element_size = 0;
+        uint64_t hash = 0;
+        size_t bytes = 0;
+        std::shared_ptr<const void> field; // const Field3D<Scalar>
+    };
+
+    mutable std::mutex mutex_;
+    std::vector<Entry> entries_;
+    size_t loads_ = 0;
+    size_t hits_ = 0;
+};
+
+// Строки [first, first + count) области field (второе измерение) — представление, которое
+// удерживает field; пустой тензор, если строк нет
+template <typename Scalar>
+Field3D<Scalar> wave_rows(const std::shared_ptr<const Field3D<Scalar>>& field, int first, int count);
+
+#endif // WAVE_CACHE_H